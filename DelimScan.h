@@ -0,0 +1,114 @@
+/*
+ * DelimScan.h
+ * Created: October 2026
+ *
+ * This file provides a scanner for the first of up to four delimiter bytes
+ * (e.g. '<', '>', ',' and ';') in a buffer, for the parsing paths that have
+ * a whole buffer in hand rather than a byte at a time: replays from a
+ * MemoryStream, the telecommand parameter list, and the ground tools.
+ *
+ * On hosts with SSE2 (any x86-64) it compares 16 bytes at a time, or 32 with
+ * AVX2 (-mavx2 or -march=native). Elsewhere, e.g. on the Teensy, it falls
+ * back to a scalar loop. Defining DELIMSCAN_SCALAR forces the scalar loop,
+ * for comparisons. Nothing here depends on Arduino.
+ */
+
+#ifndef DELIMSCAN_H
+#define DELIMSCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if !defined(DELIMSCAN_SCALAR) && (defined(__SSE2__) || defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+// a set of one to four delimiters, unused slots repeat the first
+struct DelimSet_t {
+    uint8_t delims[4];
+};
+
+inline DelimSet_t DelimSet(const char * delims, uint8_t num_delims)
+{
+    DelimSet_t set;
+
+    for (uint8_t i = 0; i < 4; i++) {
+        set.delims[i] = delims[(i < num_delims) ? i : 0];
+    }
+
+    return set;
+}
+
+inline size_t DelimScanScalar(const uint8_t * data, size_t length, const DelimSet_t & set)
+{
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = data[i];
+        if (c == set.delims[0] || c == set.delims[1] || c == set.delims[2] || c == set.delims[3]) return i;
+    }
+
+    return length;
+}
+
+#if !defined(DELIMSCAN_SCALAR) && defined(__SSE2__)
+inline size_t DelimScanSSE2(const uint8_t * data, size_t length, const DelimSet_t & set)
+{
+    const __m128i d0 = _mm_set1_epi8((char) set.delims[0]);
+    const __m128i d1 = _mm_set1_epi8((char) set.delims[1]);
+    const __m128i d2 = _mm_set1_epi8((char) set.delims[2]);
+    const __m128i d3 = _mm_set1_epi8((char) set.delims[3]);
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, d0), _mm_cmpeq_epi8(block, d1)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(block, d2), _mm_cmpeq_epi8(block, d3)));
+        unsigned mask = _mm_movemask_epi8(hits);
+        if (0 != mask) return i + __builtin_ctz(mask);
+    }
+
+    return i + DelimScanScalar(data + i, length - i, set);
+}
+#endif
+
+#if !defined(DELIMSCAN_SCALAR) && defined(__AVX2__)
+inline size_t DelimScanAVX2(const uint8_t * data, size_t length, const DelimSet_t & set)
+{
+    const __m256i d0 = _mm256_set1_epi8((char) set.delims[0]);
+    const __m256i d1 = _mm256_set1_epi8((char) set.delims[1]);
+    const __m256i d2 = _mm256_set1_epi8((char) set.delims[2]);
+    const __m256i d3 = _mm256_set1_epi8((char) set.delims[3]);
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, d0), _mm256_cmpeq_epi8(block, d1)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(block, d2), _mm256_cmpeq_epi8(block, d3)));
+        unsigned mask = _mm256_movemask_epi8(hits);
+        if (0 != mask) return i + __builtin_ctz(mask);
+    }
+
+    // the last 16-31 bytes
+    return i + DelimScanSSE2(data + i, length - i, set);
+}
+#endif
+
+// Returns the offset of the first delimiter in data[0, length), or length if
+// there's none. Up to 15 (SSE2) or 31 (AVX2) bytes may be read past a hit,
+// but never past length.
+inline size_t DelimScan(const uint8_t * data, size_t length, const DelimSet_t & set)
+{
+#if !defined(DELIMSCAN_SCALAR) && defined(__AVX2__)
+    return DelimScanAVX2(data, length, set);
+#elif !defined(DELIMSCAN_SCALAR) && defined(__SSE2__)
+    return DelimScanSSE2(data, length, set);
+#else
+    return DelimScanScalar(data, length, set);
+#endif
+}
+
+inline size_t DelimScan(const uint8_t * data, size_t length, const char * delims, uint8_t num_delims)
+{
+    return DelimScan(data, length, DelimSet(delims, num_delims));
+}
+
+#endif /* DELIMSCAN_H */
@@ -0,0 +1,57 @@
+/*
+ * MemoryStream.h
+ * Created: October 2026
+ *
+ * A read-only Stream over a byte array, for replaying captured OBC traffic
+ * into an XMLReader, e.g. in tests and benchmarks. It can be used through a
+ * Stream pointer, or directly as XMLReaderT<MemoryStream>, in which case
+ * the reader skips noise between messages with a bulk delimiter scan.
+ */
+
+#ifndef MEMORYSTREAM_H
+#define MEMORYSTREAM_H
+
+#include "Arduino.h"
+#include "XMLReader_v5.h"
+#include "DelimScan.h"
+#include <stdint.h>
+
+class MemoryStream : public Stream {
+public:
+    MemoryStream(const uint8_t * data, uint32_t length) : buffer(data), buffer_length(length) { };
+
+    // start reading a new buffer from the beginning
+    void reset(const uint8_t * data, uint32_t length)
+    {
+        buffer = data;
+        buffer_length = length;
+        index = 0;
+    }
+
+    int available() { return buffer_length - index; }
+    int read() { return (index < buffer_length) ? buffer[index++] : -1; }
+    int peek() { return (index < buffer_length) ? buffer[index] : -1; }
+    void flush() { };
+
+    // read-only
+    size_t write(uint8_t) { return 0; }
+
+    // discards the bytes before the next delim, or all of them
+    void skipTo(char delim) { index += DelimScan(buffer + index, buffer_length - index, &delim, 1); }
+
+private:
+    const uint8_t * buffer;
+    uint32_t buffer_length;
+    uint32_t index = 0;
+};
+
+template <>
+struct RxStreamOps<MemoryStream> {
+    static inline int read(MemoryStream * stream) { return stream->MemoryStream::read(); }
+    static inline int peek(MemoryStream * stream) { return stream->MemoryStream::peek(); }
+    static inline int available(MemoryStream * stream) { return stream->MemoryStream::available(); }
+    static inline void flush(MemoryStream * stream) { stream->MemoryStream::flush(); }
+    static inline void skipTo(MemoryStream * stream, char delim) { stream->MemoryStream::skipTo(delim); }
+};
+
+#endif /* MEMORYSTREAM_H */
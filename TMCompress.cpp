@@ -0,0 +1,177 @@
+/*
+ * TMCompress.cpp
+ * Created: October 2026
+ *
+ * This file implements the LZF block codec used for optional TM payload
+ * compression. Encoded data is a sequence of runs, each starting with a
+ * control byte:
+ *
+ *   000nnnnn                      -> n+1 literal bytes follow
+ *   lllooooo [+ l2] oooooooo      -> back-reference: length l+2 (l == 7 adds
+ *                                    an extra byte l2), offset o+1 bytes back
+ *
+ * Offsets are up to 13 bits, covering the full 8192-byte TM buffer.
+ */
+
+#include "TMCompress.h"
+#include <string.h>
+
+#define TMC_MAX_LITERAL 32
+#define TMC_MAX_OFFSET  8192
+#define TMC_MAX_MATCH   (7 + 255 + 2)
+
+static inline uint16_t TMCHash(const uint8_t * p)
+{
+    uint32_t v = ((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 8) | p[2];
+    return (uint16_t) ((v * 2654435761u) >> (32 - TMC_HASH_BITS));
+}
+
+uint16_t TMCompress(const uint8_t * in, uint16_t in_len, uint8_t * out, uint16_t out_size, TMCompressState_t * state)
+{
+    const uint8_t * ip = in;
+    const uint8_t * in_end = in + in_len;
+    uint8_t * op = out;
+    uint8_t * out_end = out + out_size;
+    uint8_t * lit_ctrl;
+    uint8_t lit = 0;
+
+    if (0 == in_len || 0 == out_size || NULL == state) return 0;
+
+    // table entries are positions + 1, so 0 is empty
+    memset(state->hash_table, 0, sizeof(state->hash_table));
+
+    // reserve the control byte for the first literal run
+    lit_ctrl = op++;
+
+    while (ip < in_end) {
+        if (ip + 2 < in_end) {
+            uint16_t h = TMCHash(ip);
+            uint16_t ref_pos = state->hash_table[h];
+            state->hash_table[h] = (uint16_t) (ip - in) + 1;
+
+            if (0 != ref_pos) {
+                const uint8_t * ref = in + ref_pos - 1;
+                uint16_t offset = (uint16_t) (ip - ref - 1);
+
+                if (offset < TMC_MAX_OFFSET && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+                    uint16_t len = 3;
+                    uint16_t max_len = (uint16_t) (in_end - ip);
+
+                    if (max_len > TMC_MAX_MATCH) max_len = TMC_MAX_MATCH;
+                    while (len < max_len && ref[len] == ip[len]) len++;
+
+                    // close the literal run, or drop its unused control byte
+                    if (0 != lit) {
+                        *lit_ctrl = lit - 1;
+                        lit = 0;
+                    } else {
+                        op--;
+                    }
+
+                    // back-reference (up to 3 bytes) plus the next literal control byte
+                    if (op + 4 > out_end) return 0;
+
+                    len -= 2;
+                    if (len < 7) {
+                        *op++ = (uint8_t) ((offset >> 8) + (len << 5));
+                    } else {
+                        *op++ = (uint8_t) ((offset >> 8) + (7 << 5));
+                        *op++ = (uint8_t) (len - 7);
+                    }
+                    *op++ = (uint8_t) (offset & 0xFF);
+
+                    ip += len + 2;
+                    lit_ctrl = op++;
+                    continue;
+                }
+            }
+        }
+
+        // literal byte
+        if (op >= out_end) return 0;
+        *op++ = *ip++;
+
+        if (TMC_MAX_LITERAL == ++lit) {
+            *lit_ctrl = lit - 1;
+            lit = 0;
+            if (op >= out_end) return 0;
+            lit_ctrl = op++;
+        }
+    }
+
+    // close the final literal run, or drop its unused control byte
+    if (0 != lit) {
+        *lit_ctrl = lit - 1;
+    } else {
+        op--;
+    }
+
+    return (uint16_t) (op - out);
+}
+
+uint16_t TMDecompress(const uint8_t * in, uint16_t in_len, uint8_t * out, uint16_t out_size)
+{
+    const uint8_t * ip = in;
+    const uint8_t * in_end = in + in_len;
+    uint8_t * op = out;
+    uint8_t * out_end = out + out_size;
+
+    while (ip < in_end) {
+        uint16_t ctrl = *ip++;
+
+        if (ctrl < TMC_MAX_LITERAL) {
+            // literal run
+            ctrl++;
+            if (ctrl > in_end - ip || ctrl > out_end - op) return 0;
+            memcpy(op, ip, ctrl);
+            op += ctrl;
+            ip += ctrl;
+        } else {
+            // back-reference
+            uint16_t len = ctrl >> 5;
+            uint16_t back;
+            const uint8_t * ref;
+
+            if (7 == len) {
+                if (ip >= in_end) return 0;
+                len += *ip++;
+            }
+            len += 2;
+
+            if (ip >= in_end) return 0;
+            back = ((ctrl & 0x1F) << 8) + *ip++ + 1;
+
+            if (back > op - out || len > out_end - op) return 0;
+            ref = op - back;
+
+            // byte-by-byte, since the reference can overlap the output
+            while (len--) {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    return (uint16_t) (op - out);
+}
+
+uint16_t TMDecodePayload(const uint8_t * in, uint16_t in_len, uint8_t * out, uint16_t out_size)
+{
+    uint16_t orig_len;
+
+    if (NULL == in || 0 == in_len) return 0;
+
+    switch (in[0]) {
+    case TMC_RAW:
+        if (in_len - TMC_RAW_HEADER_SIZE > out_size) return 0;
+        memcpy(out, in + TMC_RAW_HEADER_SIZE, in_len - TMC_RAW_HEADER_SIZE);
+        return in_len - TMC_RAW_HEADER_SIZE;
+    case TMC_LZF:
+        if (in_len < TMC_LZF_HEADER_SIZE) return 0;
+        orig_len = ((uint16_t) in[1] << 8) | in[2];
+        if (orig_len > out_size) return 0;
+        if (orig_len != TMDecompress(in + TMC_LZF_HEADER_SIZE, in_len - TMC_LZF_HEADER_SIZE, out, orig_len)) return 0;
+        return orig_len;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,50 @@
+/*
+ * TMCompress.h
+ * Created: October 2026
+ *
+ * This file declares a small LZ77-family codec (LZF block format) used to
+ * optionally compress the binary section of TM messages. It uses a fixed
+ * working-memory struct supplied by the caller and never allocates.
+ *
+ * When compression is enabled in the XMLWriter, every TM binary section
+ * starts with a header byte:
+ *
+ *   TMC_RAW: [0x00][raw data]
+ *   TMC_LZF: [0x01][original length MSB][original length LSB][LZF data]
+ *
+ * The decompressor has no Arduino dependencies so that it can be built
+ * for ground-side tools.
+ */
+
+#ifndef TMCOMPRESS_H
+#define TMCOMPRESS_H
+
+#include <stdint.h>
+
+// payload header types
+#define TMC_RAW 0x00
+#define TMC_LZF 0x01
+
+#define TMC_RAW_HEADER_SIZE 1
+#define TMC_LZF_HEADER_SIZE 3
+
+// compressor working memory: 2^TMC_HASH_BITS 16-bit entries (2 KB)
+#define TMC_HASH_BITS 10
+
+struct TMCompressState_t {
+    uint16_t hash_table[1 << TMC_HASH_BITS];
+};
+
+// Compress in_len bytes into out, returns the compressed size, or 0 if the
+// result would not fit in out_size bytes (i.e. the data is incompressible)
+uint16_t TMCompress(const uint8_t * in, uint16_t in_len, uint8_t * out, uint16_t out_size, TMCompressState_t * state);
+
+// Decompress in_len bytes into out, returns the decompressed size, or 0 if
+// the data is malformed or would not fit in out_size bytes
+uint16_t TMDecompress(const uint8_t * in, uint16_t in_len, uint8_t * out, uint16_t out_size);
+
+// Decode a flagged TM payload (either header type) into out, returns the
+// decoded size, or 0 on error
+uint16_t TMDecodePayload(const uint8_t * in, uint16_t in_len, uint8_t * out, uint16_t out_size);
+
+#endif /* TMCOMPRESS_H */
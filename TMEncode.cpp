@@ -0,0 +1,270 @@
+/*
+ * TMEncode.cpp
+ * Created: October 2026
+ *
+ * This file implements the varint, delta, delta-of-delta, and bit-packing
+ * encoders and decoders for TM data. Differences are taken with unsigned
+ * (wrapping) arithmetic, so every 32-bit input round-trips exactly.
+ */
+
+#include "TMEncode.h"
+#include <stddef.h>
+
+// --------------------------------------------------------
+// Varints
+// --------------------------------------------------------
+
+uint8_t TMEncodeVarint(uint32_t value, uint8_t * out, uint16_t out_size)
+{
+    uint8_t len = 0;
+
+    do {
+        if (len == out_size) return 0;
+        out[len++] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0x00);
+        value >>= 7;
+    } while (0 != value);
+
+    return len;
+}
+
+uint8_t TMDecodeVarint(const uint8_t * in, uint16_t in_len, uint32_t * value)
+{
+    uint32_t result = 0;
+
+    for (uint8_t i = 0; i < TME_MAX_VARINT_SIZE && i < in_len; i++) {
+        result |= (uint32_t) (in[i] & 0x7F) << (7 * i);
+
+        if (0 == (in[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+
+    // truncated, or longer than 32 bits
+    return 0;
+}
+
+// --------------------------------------------------------
+// Delta-of-previous
+// --------------------------------------------------------
+
+uint16_t TMEncodeDelta(const uint16_t * samples, uint16_t count, uint8_t * out, uint16_t out_size)
+{
+    uint16_t len = 0;
+    int32_t prev = 0;
+    uint8_t n;
+
+    if (NULL == samples || NULL == out) return 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        n = TMEncodeVarint(TMZigZag((int32_t) samples[i] - prev), out + len, out_size - len);
+        if (0 == n) return 0;
+        len += n;
+        prev = samples[i];
+    }
+
+    return len;
+}
+
+uint16_t TMEncodeDelta(const int32_t * samples, uint16_t count, uint8_t * out, uint16_t out_size)
+{
+    uint16_t len = 0;
+    uint32_t prev = 0;
+    uint8_t n;
+
+    if (NULL == samples || NULL == out) return 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        n = TMEncodeVarint(TMZigZag((int32_t) ((uint32_t) samples[i] - prev)), out + len, out_size - len);
+        if (0 == n) return 0;
+        len += n;
+        prev = (uint32_t) samples[i];
+    }
+
+    return len;
+}
+
+uint16_t TMDecodeDelta(const uint8_t * in, uint16_t in_len, uint16_t * samples, uint16_t count)
+{
+    uint16_t len = 0;
+    uint32_t zz;
+    int32_t value = 0;
+    uint8_t n;
+
+    if (NULL == in || NULL == samples) return 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        n = TMDecodeVarint(in + len, in_len - len, &zz);
+        if (0 == n) return 0;
+        len += n;
+
+        value += TMUnZigZag(zz);
+        if (value < 0 || value > 0xFFFF) return 0;
+        samples[i] = (uint16_t) value;
+    }
+
+    return len;
+}
+
+uint16_t TMDecodeDelta(const uint8_t * in, uint16_t in_len, int32_t * samples, uint16_t count)
+{
+    uint16_t len = 0;
+    uint32_t zz;
+    uint32_t value = 0;
+    uint8_t n;
+
+    if (NULL == in || NULL == samples) return 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        n = TMDecodeVarint(in + len, in_len - len, &zz);
+        if (0 == n) return 0;
+        len += n;
+
+        value += (uint32_t) TMUnZigZag(zz);
+        samples[i] = (int32_t) value;
+    }
+
+    return len;
+}
+
+// --------------------------------------------------------
+// Delta-of-delta
+// --------------------------------------------------------
+
+uint16_t TMEncodeDeltaDelta(const uint32_t * times, uint16_t count, uint8_t * out, uint16_t out_size)
+{
+    uint16_t len = 0;
+    uint32_t delta = 0;
+    uint32_t prev_delta = 0;
+    uint8_t n;
+
+    if (NULL == times || NULL == out) return 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (0 == i) {
+            n = TMEncodeVarint(times[0], out, out_size);
+        } else {
+            delta = times[i] - times[i - 1];
+            n = TMEncodeVarint(TMZigZag((int32_t) (delta - prev_delta)), out + len, out_size - len);
+            prev_delta = delta;
+        }
+
+        if (0 == n) return 0;
+        len += n;
+    }
+
+    return len;
+}
+
+uint16_t TMDecodeDeltaDelta(const uint8_t * in, uint16_t in_len, uint32_t * times, uint16_t count)
+{
+    uint16_t len = 0;
+    uint32_t value;
+    uint32_t delta = 0;
+    uint8_t n;
+
+    if (NULL == in || NULL == times) return 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        n = TMDecodeVarint(in + len, in_len - len, &value);
+        if (0 == n) return 0;
+        len += n;
+
+        if (0 == i) {
+            times[0] = value;
+        } else {
+            delta += (uint32_t) TMUnZigZag(value);
+            times[i] = times[i - 1] + delta;
+        }
+    }
+
+    return len;
+}
+
+// --------------------------------------------------------
+// Bit packing
+// --------------------------------------------------------
+
+uint16_t TMPackBits(const uint16_t * samples, uint16_t count, uint8_t nbits, uint8_t * out, uint16_t out_size)
+{
+    uint32_t acc = 0;
+    uint8_t acc_bits = 0;
+    uint16_t len = 0;
+    uint16_t mask;
+
+    if (NULL == samples || NULL == out || 0 == nbits || nbits > 16) return 0;
+    if (((uint32_t) count * nbits + 7) / 8 > out_size) return 0;
+    mask = (uint16_t) ((1UL << nbits) - 1);
+
+    for (uint16_t i = 0; i < count; i++) {
+        acc = (acc << nbits) | (samples[i] & mask);
+        acc_bits += nbits;
+
+        while (acc_bits >= 8) {
+            acc_bits -= 8;
+            out[len++] = (uint8_t) (acc >> acc_bits);
+        }
+    }
+
+    // zero-pad the last byte
+    if (0 != acc_bits) {
+        out[len++] = (uint8_t) (acc << (8 - acc_bits));
+    }
+
+    return len;
+}
+
+uint16_t TMUnpackBits(const uint8_t * in, uint16_t in_len, uint8_t nbits, uint16_t * samples, uint16_t count)
+{
+    uint32_t acc = 0;
+    uint8_t acc_bits = 0;
+    uint16_t len = 0;
+    uint16_t mask;
+
+    if (NULL == in || NULL == samples || 0 == nbits || nbits > 16) return 0;
+    if (((uint32_t) count * nbits + 7) / 8 > in_len) return 0;
+    mask = (uint16_t) ((1UL << nbits) - 1);
+
+    for (uint16_t i = 0; i < count; i++) {
+        while (acc_bits < nbits) {
+            acc = (acc << 8) | in[len++];
+            acc_bits += 8;
+        }
+
+        acc_bits -= nbits;
+        samples[i] = (uint16_t) (acc >> acc_bits) & mask;
+    }
+
+    return len;
+}
+
+void TMBitReaderInit(TMBitReader_t * reader, const uint8_t * data, uint16_t length)
+{
+    reader->data = data;
+    reader->length = length;
+    reader->bit_pos = 0;
+}
+
+bool TMReadBits(TMBitReader_t * reader, uint8_t nbits, uint32_t * value)
+{
+    uint32_t result = 0;
+    uint32_t byte_index;
+    uint8_t bit_offset, take;
+
+    if (0 == nbits || nbits > 32) return false;
+    if (reader->bit_pos + nbits > (uint32_t) reader->length * 8) return false;
+
+    while (0 != nbits) {
+        byte_index = reader->bit_pos / 8;
+        bit_offset = reader->bit_pos % 8;
+        take = 8 - bit_offset;
+        if (take > nbits) take = nbits;
+
+        result = (result << take) | ((reader->data[byte_index] >> (8 - bit_offset - take)) & ((1 << take) - 1));
+        reader->bit_pos += take;
+        nbits -= take;
+    }
+
+    *value = result;
+    return true;
+}
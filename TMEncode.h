@@ -0,0 +1,73 @@
+/*
+ * TMEncode.h
+ * Created: October 2026
+ *
+ * This file declares compact encoders for slowly varying time-series TM data
+ * and their matching decoders:
+ *
+ *  - Varints: unsigned LEB128, 7 bits per byte with the MSB set on all but
+ *    the last byte (at most 5 bytes for 32 bits)
+ *  - Zig-zag: maps signed values to unsigned so small magnitudes of either
+ *    sign become short varints
+ *  - Delta: the first sample, then each sample's difference from the previous
+ *    one, all as zig-zag varints
+ *  - Delta-of-delta: for timestamps, the first timestamp as a varint, the
+ *    first difference as a zig-zag varint, then the change in difference as
+ *    zig-zag varints (0 for a steady cadence)
+ *  - Bit packing: N-bit fields packed MSB-first with no padding between
+ *    fields, and the last byte zero-padded
+ *
+ * Each encoded block is self-contained, so it can be decoded from a single
+ * TM. Sample counts aren't encoded, the decoder must be given the count.
+ * Encoders return the number of bytes written, or 0 if the block doesn't
+ * fit. Decoders return the number of bytes consumed, or 0 on error. Nothing
+ * here depends on Arduino, so it can be built for ground-side tools.
+ */
+
+#ifndef TMENCODE_H
+#define TMENCODE_H
+
+#include <stdint.h>
+
+// longest varint for a 32-bit value
+#define TME_MAX_VARINT_SIZE 5
+
+inline uint32_t TMZigZag(int32_t value)
+{
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+inline int32_t TMUnZigZag(uint32_t value)
+{
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+// single values
+uint8_t TMEncodeVarint(uint32_t value, uint8_t * out, uint16_t out_size);
+uint8_t TMDecodeVarint(const uint8_t * in, uint16_t in_len, uint32_t * value);
+
+// delta-of-previous sample blocks
+uint16_t TMEncodeDelta(const uint16_t * samples, uint16_t count, uint8_t * out, uint16_t out_size);
+uint16_t TMEncodeDelta(const int32_t * samples, uint16_t count, uint8_t * out, uint16_t out_size);
+uint16_t TMDecodeDelta(const uint8_t * in, uint16_t in_len, uint16_t * samples, uint16_t count);
+uint16_t TMDecodeDelta(const uint8_t * in, uint16_t in_len, int32_t * samples, uint16_t count);
+
+// delta-of-delta timestamp blocks
+uint16_t TMEncodeDeltaDelta(const uint32_t * times, uint16_t count, uint8_t * out, uint16_t out_size);
+uint16_t TMDecodeDeltaDelta(const uint8_t * in, uint16_t in_len, uint32_t * times, uint16_t count);
+
+// N-bit packed sample blocks (nbits 1-16), starting byte-aligned
+uint16_t TMPackBits(const uint16_t * samples, uint16_t count, uint8_t nbits, uint8_t * out, uint16_t out_size);
+uint16_t TMUnpackBits(const uint8_t * in, uint16_t in_len, uint8_t nbits, uint16_t * samples, uint16_t count);
+
+// sequential reads of mixed-width bit fields (nbits 1-32)
+struct TMBitReader_t {
+    const uint8_t * data;
+    uint16_t length;
+    uint32_t bit_pos;
+};
+
+void TMBitReaderInit(TMBitReader_t * reader, const uint8_t * data, uint16_t length);
+bool TMReadBits(TMBitReader_t * reader, uint8_t nbits, uint32_t * value);
+
+#endif /* TMENCODE_H */
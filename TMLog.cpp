@@ -0,0 +1,109 @@
+/*
+ * TMLog.cpp
+ * Created: October 2026
+ *
+ * This file implements the deferred binary log.
+ */
+
+#include "TMLog.h"
+#include <string.h>
+
+bool TMLog::flush(XMLWriter * writer)
+{
+    uint8_t header[TMLOG_HEADER_MAXSIZE];
+    uint8_t header_len = 0;
+
+    if (0 == log_count) return false;
+
+    header[header_len++] = TMLOG_MAGIC;
+    header[header_len++] = TMLOG_VERSION;
+    header_len += TMEncodeVarint(log_count, header + header_len, TMLOG_HEADER_MAXSIZE - header_len);
+    header[header_len++] = base_time >> 24;
+    header[header_len++] = (base_time >> 16) & 0xFF;
+    header[header_len++] = (base_time >> 8) & 0xFF;
+    header[header_len++] = base_time & 0xFF;
+
+    writer->clearTm();
+    if (!writer->addTm(header, header_len) || !writer->addTm(log_buffer, log_length)) {
+        writer->clearTm();
+        return false;
+    }
+
+    writer->TM();
+    clear();
+    return true;
+}
+
+void TMLog::clear()
+{
+    log_length = 0;
+    log_count = 0;
+}
+
+uint16_t TMLog::getCount()
+{
+    return log_count;
+}
+
+uint16_t TMLog::getLength()
+{
+    return log_length;
+}
+
+uint32_t TMLog::getDropped()
+{
+    return log_dropped;
+}
+
+bool TMLog::beginRecord(uint16_t id)
+{
+    uint32_t now = millis();
+
+    // the first record's time goes in the header
+    if (0 == log_count) {
+        base_time = now;
+        last_time = now;
+    }
+
+    if (!putVarint(id) || !putVarint(now - last_time)) return false;
+
+    last_time = now;
+    return true;
+}
+
+bool TMLog::putVarint(uint32_t value)
+{
+    uint8_t num_bytes = TMEncodeVarint(value, log_buffer + log_length, TMLOG_SIZE - log_length);
+
+    log_length += num_bytes;
+    return 0 != num_bytes;
+}
+
+bool TMLog::putFloat(float value)
+{
+    uint32_t bits;
+
+    if (TMLOG_SIZE - log_length < 4) return false;
+
+    memcpy(&bits, &value, 4);
+    log_buffer[log_length++] = bits >> 24;
+    log_buffer[log_length++] = (bits >> 16) & 0xFF;
+    log_buffer[log_length++] = (bits >> 8) & 0xFF;
+    log_buffer[log_length++] = bits & 0xFF;
+    return true;
+}
+
+bool TMLog::putString(const char * value)
+{
+    uint16_t length = 0;
+
+    if (NULL == value) value = "";
+
+    while (length < TMLOG_MAX_STRING && '\0' != value[length]) length++;
+
+    if (!putVarint(length) || TMLOG_SIZE - log_length < length) return false;
+
+    memcpy(log_buffer + log_length, value, length);
+    log_length += length;
+    return true;
+}
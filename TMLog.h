@@ -0,0 +1,103 @@
+/*
+ * TMLog.h
+ * Created: October 2026
+ *
+ * This file declares a deferred binary log: instead of formatting a line and
+ * sending it as a TM_String, a log call records only the message id and its
+ * raw arguments in a compact buffer. The buffer is sent as a single TM when
+ * flushed, and expanded on the ground with the format strings by
+ * tools/tmlog_expand.cpp. See TMLogFormat.h for declaring the messages and
+ * for the payload format.
+ *
+ *     zephyrLog.log(LOG_TEMP, channel, temperature);
+ *     ...
+ *     zephyrLog.flush(&zephyrTX); // e.g. every few minutes, or when full
+ *
+ * The arguments must match the format string's conversions, as with printf:
+ * %d/%i take signed integers, %u/%x/%X/%o/%c unsigned integers or chars,
+ * %f/%e/%g floats or doubles (sent as float), and %s strings.
+ */
+
+#ifndef TMLOG_H
+#define TMLOG_H
+
+#include "TMLogFormat.h"
+#include "TMEncode.h"
+#include "XMLWriter_v5.h"
+#include <stdint.h>
+
+// Bytes of records held between flushes, must fit in a TM with the header
+#ifndef TMLOG_SIZE
+#define TMLOG_SIZE 1024
+#endif
+
+class TMLog {
+public:
+    TMLog() { };
+
+    // records the message, false if it doesn't fit (it's then counted as dropped)
+    template <typename... Args>
+    bool log(uint16_t id, Args... args)
+    {
+        uint16_t start = log_length;
+        uint32_t prev_time = last_time;
+
+        if (!beginRecord(id) || !putArgs(args...)) {
+            log_length = start;
+            last_time = prev_time;
+            log_dropped++;
+            return false;
+        }
+
+        log_count++;
+        return true;
+    }
+
+    // Sends the records as one TM and clears them. The writer's TM buffer is
+    // cleared first, so only flush when it holds nothing still to be sent.
+    bool flush(XMLWriter * writer);
+    void clear();
+
+    uint16_t getCount(); // records waiting
+    uint16_t getLength(); // bytes waiting
+    uint32_t getDropped(); // records that didn't fit
+
+private:
+    bool beginRecord(uint16_t id);
+    bool putVarint(uint32_t value);
+    bool putSigned(int32_t value) { return putVarint(TMZigZag(value)); }
+    bool putFloat(float value);
+    bool putString(const char * value);
+
+    // one overload per argument type, so every integer type matches exactly
+    bool putArg(signed char value) { return putSigned(value); }
+    bool putArg(short value) { return putSigned(value); }
+    bool putArg(int value) { return putSigned(value); }
+    bool putArg(long value) { return putSigned(value); }
+    bool putArg(unsigned char value) { return putVarint(value); }
+    bool putArg(unsigned short value) { return putVarint(value); }
+    bool putArg(unsigned int value) { return putVarint(value); }
+    bool putArg(unsigned long value) { return putVarint(value); }
+    bool putArg(char value) { return putVarint((uint8_t) value); }
+    bool putArg(bool value) { return putVarint(value); }
+    bool putArg(float value) { return putFloat(value); }
+    bool putArg(double value) { return putFloat((float) value); }
+    bool putArg(const char * value) { return putString(value); }
+
+    bool putArgs() { return true; }
+
+    template <typename T, typename... Rest>
+    bool putArgs(T first, Rest... rest)
+    {
+        return putArg(first) && putArgs(rest...);
+    }
+
+    uint8_t log_buffer[TMLOG_SIZE];
+    uint16_t log_length = 0;
+    uint16_t log_count = 0;
+    uint32_t log_dropped = 0;
+    uint32_t base_time = 0; // of the first record
+    uint32_t last_time = 0; // of the latest record
+};
+
+#endif /* TMLOG_H */
@@ -0,0 +1,44 @@
+/*
+ * TMLogFormat.h
+ * Created: October 2026
+ *
+ * This file defines the payload format of deferred log TMs (see TMLog.h), and
+ * the macros that declare an instrument's log messages. The messages are
+ * listed once, in a header shared by the instrument and the ground tool
+ * (tools/tmlog_expand.cpp), so both see the same ids and format strings:
+ *
+ *     #define LPC_LOG_MESSAGES(X) \
+ *         X(LOG_BOOT, "Booted, software %u.%u") \
+ *         X(LOG_TEMP, "Channel %u at %.1f C")
+ *
+ *     TMLOG_DECLARE(LPC_LOG_MESSAGES)
+ *
+ * Payload: TMLOG_MAGIC, TMLOG_VERSION, the record count (varint), and the
+ * time of the first record (ms, 4 bytes big-endian), then the records. Each
+ * record is its id (varint), the ms since the previous record (varint), and
+ * its arguments in order: signed integers as zig-zag varints, unsigned
+ * integers and chars as varints, floating point as 4-byte big-endian floats,
+ * and strings as a varint length and the characters, truncated to
+ * TMLOG_MAX_STRING. Nothing here depends on Arduino.
+ */
+
+#ifndef TMLOGFORMAT_H
+#define TMLOGFORMAT_H
+
+#include <stdint.h>
+
+#define TMLOG_MAGIC         0xB1
+#define TMLOG_VERSION       1
+#define TMLOG_MAX_STRING    64
+
+// magic, version, count varint, base time
+#define TMLOG_HEADER_MAXSIZE (2 + 5 + 4)
+
+#define TMLOG_ENUM_ENTRY(name, format) name,
+#define TMLOG_FORMAT_ENTRY(name, format) format,
+
+// declares the TMLogId_t enum of the listed messages, one list per program
+#define TMLOG_DECLARE(LIST) \
+    enum TMLogId_t : uint16_t { LIST(TMLOG_ENUM_ENTRY) NUM_TMLOG_IDS };
+
+#endif /* TMLOGFORMAT_H */
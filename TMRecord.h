@@ -0,0 +1,173 @@
+/*
+ * TMRecord.h
+ * Created: October 2026
+ *
+ * This file provides compile-time record descriptions for packing structs
+ * into TM buffers. A record lists the struct members to send, in order:
+ *
+ *   struct HK_t { uint16_t temp; int16_t current; float pos[3]; uint8_t flags; };
+ *
+ *   typedef TMRecord<TM_FIELD(HK_t, temp), TM_FIELD(HK_t, current),
+ *                    TM_FIELD(HK_t, pos), TM_FIELD(HK_t, flags)> HKRecord;
+ *
+ *   zephyrTX.addTmRecord<HKRecord>(hk);          // instrument side
+ *   HKRecord::decode(payload, length, &hk);      // ground side
+ *
+ * Every field is big-endian on the wire, with no padding. Sizes and byte
+ * orders are fixed at compile time, so packing a record is a single bounds
+ * check followed by unrolled stores, and the encoder and decoder can't
+ * disagree. Supported member types are integers, enums, bool, float, double,
+ * and fixed-size arrays of these. Nothing here depends on Arduino, so the
+ * same description can be compiled into ground-side tools.
+ */
+
+#ifndef TMRECORD_H
+#define TMRECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// unsigned integer of a given size, for byte-order conversion
+template <size_t N> struct TMUInt;
+template <> struct TMUInt<1> { typedef uint8_t type; };
+template <> struct TMUInt<2> { typedef uint16_t type; };
+template <> struct TMUInt<4> { typedef uint32_t type; };
+template <> struct TMUInt<8> { typedef uint64_t type; };
+
+// --------------------------------------------------------
+// Big-endian codecs per member type
+// --------------------------------------------------------
+
+// integers, enums, and bool
+template <typename T>
+struct TMCodec {
+    typedef typename TMUInt<sizeof(T)>::type U;
+    static const uint16_t size = sizeof(T);
+
+    static void put(uint8_t * out, const T & value)
+    {
+        U u = (U) value;
+        for (uint16_t i = 0; i < size; i++) {
+            out[i] = (uint8_t) (u >> (8 * (size - 1 - i)));
+        }
+    }
+
+    static void get(const uint8_t * in, T & value)
+    {
+        U u = 0;
+        for (uint16_t i = 0; i < size; i++) {
+            u = (U) ((u << 8) | in[i]);
+        }
+        value = (T) u;
+    }
+};
+
+// floating point types are sent as their IEEE 754 bit patterns
+template <typename T, typename U>
+struct TMFloatCodec {
+    static const uint16_t size = sizeof(T);
+
+    static void put(uint8_t * out, const T & value)
+    {
+        U bits;
+        memcpy(&bits, &value, sizeof(T));
+        TMCodec<U>::put(out, bits);
+    }
+
+    static void get(const uint8_t * in, T & value)
+    {
+        U bits;
+        TMCodec<U>::get(in, bits);
+        memcpy(&value, &bits, sizeof(T));
+    }
+};
+
+template <> struct TMCodec<float> : TMFloatCodec<float, uint32_t> { };
+template <> struct TMCodec<double> : TMFloatCodec<double, uint64_t> { };
+
+// fixed-size arrays, element by element
+template <typename T, size_t N>
+struct TMCodec<T[N]> {
+    static const uint16_t size = N * TMCodec<T>::size;
+
+    static void put(uint8_t * out, const T (&value)[N])
+    {
+        for (size_t i = 0; i < N; i++) {
+            TMCodec<T>::put(out + i * TMCodec<T>::size, value[i]);
+        }
+    }
+
+    static void get(const uint8_t * in, T (&value)[N])
+    {
+        for (size_t i = 0; i < N; i++) {
+            TMCodec<T>::get(in + i * TMCodec<T>::size, value[i]);
+        }
+    }
+};
+
+// --------------------------------------------------------
+// Record descriptions
+// --------------------------------------------------------
+
+// one struct member in a record
+template <typename S, typename T, T S::*Member>
+struct TMField {
+    static const uint16_t size = TMCodec<T>::size;
+
+    static void pack(const S & record, uint8_t * out) { TMCodec<T>::put(out, record.*Member); }
+    static void unpack(S & record, const uint8_t * in) { TMCodec<T>::get(in, record.*Member); }
+};
+
+#define TM_FIELD(S, member) TMField<S, decltype(S::member), &S::member>
+
+// an ordered list of fields, packed back-to-back
+template <typename... Fields> struct TMRecord;
+
+template <>
+struct TMRecord<> {
+    static const uint16_t size = 0;
+
+    template <typename S> static void pack(const S &, uint8_t *) { }
+    template <typename S> static void unpack(S &, const uint8_t *) { }
+};
+
+template <typename First, typename... Rest>
+struct TMRecord<First, Rest...> {
+    static const uint16_t size = First::size + TMRecord<Rest...>::size;
+
+    // out must have room for size bytes
+    template <typename S>
+    static void pack(const S & record, uint8_t * out)
+    {
+        First::pack(record, out);
+        TMRecord<Rest...>::pack(record, out + First::size);
+    }
+
+    // in must hold size bytes
+    template <typename S>
+    static void unpack(S & record, const uint8_t * in)
+    {
+        First::unpack(record, in);
+        TMRecord<Rest...>::unpack(record, in + First::size);
+    }
+
+    // bounds-checked versions, returning the bytes written/read or 0 if too short
+    template <typename S>
+    static uint16_t encode(const S & record, uint8_t * out, uint16_t out_size)
+    {
+        if (out_size < size) return 0;
+        pack(record, out);
+        return size;
+    }
+
+    template <typename S>
+    static uint16_t decode(const uint8_t * in, uint16_t in_len, S * record)
+    {
+        if (NULL == record || in_len < size) return 0;
+        unpack(*record, in);
+        return size;
+    }
+};
+
+#endif /* TMRECORD_H */
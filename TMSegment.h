@@ -0,0 +1,44 @@
+/*
+ * TMSegment.h
+ * Created: October 2026
+ *
+ * This file defines the header that starts every TM of a segmented transfer,
+ * used for data larger than a single TM buffer (e.g. LPC frame files or PU
+ * profiles). The XMLWriter pulls the data from a TMSource_t callback one
+ * segment at a time, so the full transfer never has to be held in RAM.
+ *
+ * On the ground, each segment's data is written at its offset, and the
+ * transfer is complete once the TMSEG_LAST segment and every byte before
+ * it have been received.
+ */
+
+#ifndef TMSEGMENT_H
+#define TMSEGMENT_H
+
+#include "TMRecord.h"
+#include <stdint.h>
+
+// header flags
+#define TMSEG_LAST 0x01
+
+struct TMSegmentHeader_t {
+    uint16_t transfer_id; // chosen by the instrument per transfer
+    uint16_t index;       // segment number, from 0
+    uint16_t count;       // total segments, 0 if the length wasn't known
+    uint32_t offset;      // byte offset of this segment's data in the transfer
+    uint8_t flags;
+};
+
+// big-endian wire layout, shared by the writer and ground decoders
+typedef TMRecord<TM_FIELD(TMSegmentHeader_t, transfer_id),
+                 TM_FIELD(TMSegmentHeader_t, index),
+                 TM_FIELD(TMSegmentHeader_t, count),
+                 TM_FIELD(TMSegmentHeader_t, offset),
+                 TM_FIELD(TMSegmentHeader_t, flags)> TMSegmentRecord;
+
+// Fills up to max_bytes of the transfer's next data into buffer, returning
+// the number of bytes written. With an unknown total length, returning fewer
+// than max_bytes ends the transfer; with a known one, it fails the transfer.
+typedef uint16_t (*TMSource_t)(uint8_t * buffer, uint16_t max_bytes, void * context);
+
+#endif /* TMSEGMENT_H */
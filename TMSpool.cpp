@@ -0,0 +1,418 @@
+/*
+ * TMSpool.cpp
+ * Created: October 2026
+ *
+ * This file implements the append-only TM spool.
+ */
+
+#include "TMSpool.h"
+#include <stddef.h>
+
+#ifndef ARDUINO
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// bytes read at a time when checking a record's crc during replay
+#define SPOOL_CHUNK_SIZE 64
+
+// bitwise CRC-CCITT16, with the same initial value as the XML messages
+static uint16_t spoolCrc(uint16_t crc, const uint8_t * data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= (uint16_t) data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static void putHeader(uint8_t * header, uint8_t type, uint16_t length, uint32_t seq)
+{
+    header[0] = TMSPOOL_MAGIC;
+    header[1] = type;
+    header[2] = length >> 8;
+    header[3] = length & 0xFF;
+    header[4] = seq >> 24;
+    header[5] = (seq >> 16) & 0xFF;
+    header[6] = (seq >> 8) & 0xFF;
+    header[7] = seq & 0xFF;
+}
+
+// --------------------------------------------------------
+// Replay
+// --------------------------------------------------------
+
+uint32_t TMSpool::begin(TMSpoolStorage * spool_storage)
+{
+    uint32_t offset = 0;
+    uint32_t last_seq = 0;
+    uint32_t capacity;
+    uint8_t type;
+    uint16_t length, crc;
+    uint32_t seq;
+
+    storage = spool_storage;
+    index_head = 0;
+    index_count = 0;
+    unindexed = false;
+    delivered_seq = 0;
+
+    if (NULL == storage) return 0;
+
+    capacity = storage->capacity();
+
+    // replay up to the first record that's torn, corrupt, or out of sequence
+    while (offset + TMSPOOL_HEADER_SIZE <= capacity) {
+        if (!readHeader(offset, &type, &length, &seq, &crc)) break;
+
+        if (TMSPOOL_DATA == type) {
+            if (0 != last_seq && seq != last_seq + 1) break;
+        } else if (TMSPOOL_ACK == type) {
+            if (0 != length || seq > last_seq) break;
+        } else {
+            break;
+        }
+
+        if (offset + TMSPOOL_HEADER_SIZE + length > capacity) break;
+
+        uint8_t header[8];
+        putHeader(header, type, length, seq);
+        if (!checkRecord(offset, length, spoolCrc(0x1021, header, 8), crc)) break;
+
+        if (TMSPOOL_DATA == type) {
+            // nothing before the first record is pending
+            if (0 == last_seq) delivered_seq = seq - 1;
+            last_seq = seq;
+            indexRecord(offset, seq, length);
+        } else {
+            if (seq > delivered_seq) delivered_seq = seq;
+            popDelivered();
+        }
+
+        offset += TMSPOOL_HEADER_SIZE + length;
+    }
+
+    next_seq = last_seq + 1;
+    append_offset = offset;
+
+    // drop a torn tail, or start over if everything was delivered
+    if (last_seq <= delivered_seq) {
+        append_offset = 0;
+        unindexed = false;
+    }
+    storage->truncate(append_offset);
+
+    refillIndex();
+
+    return last_seq > delivered_seq ? last_seq - delivered_seq : 0;
+}
+
+bool TMSpool::readHeader(uint32_t offset, uint8_t * type, uint16_t * length, uint32_t * seq, uint16_t * crc)
+{
+    uint8_t header[TMSPOOL_HEADER_SIZE];
+
+    if (!storage->read(offset, header, TMSPOOL_HEADER_SIZE)) return false;
+    if (TMSPOOL_MAGIC != header[0]) return false;
+
+    *type = header[1];
+    *length = ((uint16_t) header[2] << 8) | header[3];
+    *seq = ((uint32_t) header[4] << 24) | ((uint32_t) header[5] << 16) | ((uint32_t) header[6] << 8) | header[7];
+    *crc = ((uint16_t) header[8] << 8) | header[9];
+    return true;
+}
+
+bool TMSpool::checkRecord(uint32_t offset, uint16_t length, uint16_t header_crc, uint16_t expected_crc)
+{
+    uint8_t chunk[SPOOL_CHUNK_SIZE];
+    uint16_t crc = header_crc;
+    uint16_t done = 0;
+
+    offset += TMSPOOL_HEADER_SIZE;
+    while (done < length) {
+        uint16_t num_bytes = (length - done < SPOOL_CHUNK_SIZE) ? length - done : SPOOL_CHUNK_SIZE;
+
+        if (!storage->read(offset + done, chunk, num_bytes)) return false;
+        crc = spoolCrc(crc, chunk, num_bytes);
+        done += num_bytes;
+    }
+
+    return crc == expected_crc;
+}
+
+// --------------------------------------------------------
+// Appending and delivery
+// --------------------------------------------------------
+
+bool TMSpool::writeRecord(uint8_t type, uint32_t seq, const uint8_t * payload, uint16_t length)
+{
+    uint8_t header[TMSPOOL_HEADER_SIZE];
+    uint16_t crc;
+
+    if (append_offset + TMSPOOL_HEADER_SIZE + length > storage->capacity()) return false;
+
+    putHeader(header, type, length, seq);
+    crc = spoolCrc(spoolCrc(0x1021, header, 8), payload, length);
+    header[8] = crc >> 8;
+    header[9] = crc & 0xFF;
+
+    // a reset part way through leaves a record that fails its crc on replay
+    if (0 != length && !storage->write(append_offset + TMSPOOL_HEADER_SIZE, payload, length)) return false;
+    if (!storage->write(append_offset, header, TMSPOOL_HEADER_SIZE) || !storage->sync()) return false;
+
+    append_offset += TMSPOOL_HEADER_SIZE + length;
+    return true;
+}
+
+uint32_t TMSpool::append(const uint8_t * payload, uint16_t length)
+{
+    uint32_t offset = append_offset;
+
+    // an empty record would never be sent, so never acked
+    if (NULL == storage || 0 == length || !writeRecord(TMSPOOL_DATA, next_seq, payload, length)) return 0;
+
+    indexRecord(offset, next_seq, length);
+    return next_seq++;
+}
+
+uint16_t TMSpool::next(uint8_t * buffer, uint16_t max_length, uint32_t * seq)
+{
+    while (index_count > 0) {
+        TMSpoolEntry_t * entry = NULL;
+        uint8_t type;
+        uint16_t length, crc;
+        uint32_t record_seq;
+
+        for (uint16_t i = 0; i < index_count; i++) {
+            TMSpoolEntry_t * candidate = &index[(index_head + i) % TMSPOOL_INDEX_SIZE];
+            // a record too large for this buffer stays pending
+            if (!candidate->in_flight && !candidate->acked && candidate->length <= max_length) {
+                entry = candidate;
+                break;
+            }
+        }
+
+        if (NULL == entry) return 0;
+
+        // nothing to send, e.g. appended before empty records were rejected
+        if (0 == entry->length) {
+            ack(entry->seq);
+            continue;
+        }
+
+        if (readHeader(entry->offset, &type, &length, &record_seq, &crc) &&
+            TMSPOOL_DATA == type && entry->seq == record_seq && entry->length == length &&
+            storage->read(entry->offset + TMSPOOL_HEADER_SIZE, buffer, length)) {
+            uint8_t header[8];
+            putHeader(header, type, length, record_seq);
+            if (crc == spoolCrc(spoolCrc(0x1021, header, 8), buffer, length)) {
+                entry->in_flight = true;
+                *seq = entry->seq;
+                return length;
+            }
+        }
+
+        // the storage went bad since it was written: skip the record
+        corrupt++;
+        ack(entry->seq);
+    }
+
+    return 0;
+}
+
+void TMSpool::ack(uint32_t seq)
+{
+    TMSpoolEntry_t * entry = findEntry(seq);
+    uint32_t previous = delivered_seq;
+
+    if (NULL == entry) return;
+
+    entry->in_flight = false;
+    entry->acked = true;
+    popDelivered();
+
+    if (!pending()) {
+        // everything's delivered, start over
+        append_offset = 0;
+        storage->truncate(0);
+        return;
+    }
+
+    // if this fails the records are sent again after a reset
+    if (delivered_seq != previous) writeRecord(TMSPOOL_ACK, delivered_seq, NULL, 0);
+
+    refillIndex();
+}
+
+void TMSpool::release(uint32_t seq)
+{
+    TMSpoolEntry_t * entry = findEntry(seq);
+
+    if (NULL != entry) entry->in_flight = false;
+}
+
+bool TMSpool::pending()
+{
+    return 0 != index_count || unindexed;
+}
+
+uint16_t TMSpool::getIndexed()
+{
+    return index_count;
+}
+
+uint32_t TMSpool::getUsed()
+{
+    return append_offset;
+}
+
+uint32_t TMSpool::getCorrupt()
+{
+    return corrupt;
+}
+
+// --------------------------------------------------------
+// Index
+// --------------------------------------------------------
+
+TMSpoolEntry_t * TMSpool::findEntry(uint32_t seq)
+{
+    for (uint16_t i = 0; i < index_count; i++) {
+        TMSpoolEntry_t * entry = &index[(index_head + i) % TMSPOOL_INDEX_SIZE];
+        if (seq == entry->seq) return entry;
+    }
+
+    return NULL;
+}
+
+void TMSpool::indexRecord(uint32_t offset, uint32_t seq, uint16_t length)
+{
+    // keep the index in order: once a record is left out, so are later ones
+    if (unindexed || TMSPOOL_INDEX_SIZE == index_count) {
+        if (!unindexed) {
+            unindexed = true;
+            scan_offset = offset;
+        }
+        return;
+    }
+
+    addEntry(offset, seq, length);
+}
+
+void TMSpool::addEntry(uint32_t offset, uint32_t seq, uint16_t length)
+{
+    TMSpoolEntry_t * entry = &index[(index_head + index_count) % TMSPOOL_INDEX_SIZE];
+
+    entry->offset = offset;
+    entry->seq = seq;
+    entry->length = length;
+    entry->in_flight = false;
+    entry->acked = false;
+    index_count++;
+}
+
+// index records left in storage, skipping any already delivered
+void TMSpool::refillIndex()
+{
+    uint8_t type;
+    uint16_t length, crc;
+    uint32_t seq;
+
+    while (unindexed && index_count < TMSPOOL_INDEX_SIZE) {
+        if (scan_offset >= append_offset || !readHeader(scan_offset, &type, &length, &seq, &crc)) {
+            unindexed = false;
+            break;
+        }
+
+        if (TMSPOOL_DATA == type && seq > delivered_seq) addEntry(scan_offset, seq, length);
+
+        scan_offset += TMSPOOL_HEADER_SIZE + length;
+    }
+
+    if (scan_offset >= append_offset) unindexed = false;
+}
+
+// drop delivered records from the front of the index
+void TMSpool::popDelivered()
+{
+    while (index_count > 0) {
+        TMSpoolEntry_t * entry = &index[index_head];
+
+        if (!entry->acked && entry->seq > delivered_seq) break;
+
+        if (entry->seq > delivered_seq) delivered_seq = entry->seq;
+        index_head = (index_head + 1) % TMSPOOL_INDEX_SIZE;
+        index_count--;
+    }
+}
+
+// --------------------------------------------------------
+// File storage
+// --------------------------------------------------------
+
+#ifndef ARDUINO
+
+TMSpoolFile::~TMSpoolFile()
+{
+    close();
+}
+
+bool TMSpoolFile::open(const char * path, uint32_t max_bytes)
+{
+    close();
+
+    fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    max_size = max_bytes;
+    return fd >= 0;
+}
+
+void TMSpoolFile::close()
+{
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+bool TMSpoolFile::read(uint32_t offset, uint8_t * buffer, uint16_t length)
+{
+    uint16_t done = 0;
+
+    while (done < length) {
+        ssize_t num_read = pread(fd, buffer + done, length - done, offset + done);
+        if (num_read <= 0) return false;
+        done += num_read;
+    }
+
+    return true;
+}
+
+bool TMSpoolFile::write(uint32_t offset, const uint8_t * buffer, uint16_t length)
+{
+    uint16_t done = 0;
+
+    while (done < length) {
+        ssize_t num_written = pwrite(fd, buffer + done, length - done, offset + done);
+        if (num_written <= 0) return false;
+        done += num_written;
+    }
+
+    return true;
+}
+
+bool TMSpoolFile::sync()
+{
+    return 0 == fsync(fd);
+}
+
+bool TMSpoolFile::truncate(uint32_t length)
+{
+    return 0 == ftruncate(fd, length) && 0 == fsync(fd);
+}
+
+uint32_t TMSpoolFile::capacity()
+{
+    return fd >= 0 ? max_size : 0;
+}
+
+#endif
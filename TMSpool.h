@@ -0,0 +1,138 @@
+/*
+ * TMSpool.h
+ * Created: October 2026
+ *
+ * This file declares an append-only spool for TM payloads that couldn't be
+ * delivered (the OBC refused them, or the link is down), so that a backlog
+ * larger than the TM buffers in RAM survives until TMAck flow resumes, and
+ * survives a reset. The XMLWriter appends frames to the spool and drains
+ * them in order (see XMLWriter::setSpool).
+ *
+ * The spool is a sequence of records on a TMSpoolStorage, a file or block
+ * device. Every record starts with a 10-byte header, big-endian:
+ *
+ *   [TMSPOOL_MAGIC][type][length (2)][seq (4)][crc (2)]
+ *
+ * followed by length payload bytes. The crc is CRC-CCITT over the first
+ * 8 header bytes and the payload. TMSPOOL_DATA records hold one TM payload,
+ * with consecutive seq numbers. TMSPOOL_ACK records have no payload: their
+ * seq marks every data record up to it as delivered. Records are only ever
+ * appended, and each append is synced, so after a reset begin() replays
+ * the records up to the first torn or corrupt one, and appends from there.
+ * Once everything is delivered the storage is truncated to start over.
+ *
+ * Nothing here depends on Arduino. On Linux, TMSpoolFile stores the spool
+ * in a plain file.
+ */
+
+#ifndef TMSPOOL_H
+#define TMSPOOL_H
+
+#include <stdint.h>
+
+#define TMSPOOL_MAGIC       0x5A
+#define TMSPOOL_DATA        0x01
+#define TMSPOOL_ACK         0x02
+#define TMSPOOL_HEADER_SIZE 10
+
+// Pending records tracked in RAM: older ones beyond this stay in storage
+// and are indexed as earlier ones are delivered
+#ifndef TMSPOOL_INDEX_SIZE
+#define TMSPOOL_INDEX_SIZE 32
+#endif
+
+// Byte-addressed persistent storage. Writes only need to be durable after
+// sync(). truncate(length) must leave nothing readable as a valid record
+// from length on: a block device should erase (or zero) that range.
+class TMSpoolStorage {
+public:
+    virtual ~TMSpoolStorage() { };
+
+    virtual bool read(uint32_t offset, uint8_t * buffer, uint16_t length) = 0;
+    virtual bool write(uint32_t offset, const uint8_t * buffer, uint16_t length) = 0;
+    virtual bool sync() = 0;
+    virtual bool truncate(uint32_t length) = 0;
+    virtual uint32_t capacity() = 0; // bytes
+};
+
+struct TMSpoolEntry_t {
+    uint32_t offset; // of the record header
+    uint32_t seq;
+    uint16_t length; // payload bytes
+    bool in_flight;  // handed out by next(), not yet acked or released
+    bool acked;      // delivered, waiting for older records
+};
+
+class TMSpool {
+public:
+    TMSpool() { };
+
+    // Replays the records in storage, returns the number pending (those
+    // beyond the index are counted when they're indexed)
+    uint32_t begin(TMSpoolStorage * storage);
+
+    // Appends a payload, returns its seq (0 if it's empty, or the storage is
+    // full or fails)
+    uint32_t append(const uint8_t * payload, uint16_t length);
+
+    // Reads the oldest pending record that isn't in flight and fits in
+    // max_length into buffer and marks it in flight, returns its length
+    // (0 if there's none). Larger records stay pending.
+    uint16_t next(uint8_t * buffer, uint16_t max_length, uint32_t * seq);
+
+    void ack(uint32_t seq);     // delivered
+    void release(uint32_t seq); // not delivered, hand it out again
+
+    bool pending(); // records waiting in the index or in storage
+    uint16_t getIndexed();
+    uint32_t getUsed(); // bytes of storage in use
+    uint32_t getCorrupt(); // records unreadable when handed out, skipped
+
+private:
+    bool readHeader(uint32_t offset, uint8_t * type, uint16_t * length, uint32_t * seq, uint16_t * crc);
+    bool checkRecord(uint32_t offset, uint16_t length, uint16_t header_crc, uint16_t expected_crc);
+    bool writeRecord(uint8_t type, uint32_t seq, const uint8_t * payload, uint16_t length);
+    TMSpoolEntry_t * findEntry(uint32_t seq);
+    void indexRecord(uint32_t offset, uint32_t seq, uint16_t length);
+    void addEntry(uint32_t offset, uint32_t seq, uint16_t length);
+    void refillIndex();
+    void popDelivered();
+
+    TMSpoolStorage * storage = 0;
+
+    // ring of pending records, oldest first
+    TMSpoolEntry_t index[TMSPOOL_INDEX_SIZE];
+    uint16_t index_head = 0;
+    uint16_t index_count = 0;
+
+    uint32_t append_offset = 0; // end of the last valid record
+    uint32_t scan_offset = 0;   // first record not yet indexed, if any
+    bool unindexed = false;     // records from scan_offset on aren't indexed
+    uint32_t next_seq = 1;
+    uint32_t delivered_seq = 0; // every data record up to this is delivered
+    uint32_t corrupt = 0;
+};
+
+#ifndef ARDUINO
+// Spool storage in a plain file, for Linux ground tools and testing
+class TMSpoolFile : public TMSpoolStorage {
+public:
+    TMSpoolFile() { };
+    ~TMSpoolFile();
+
+    bool open(const char * path, uint32_t max_bytes);
+    void close();
+
+    bool read(uint32_t offset, uint8_t * buffer, uint16_t length);
+    bool write(uint32_t offset, const uint8_t * buffer, uint16_t length);
+    bool sync();
+    bool truncate(uint32_t length);
+    uint32_t capacity();
+
+private:
+    int fd = -1;
+    uint32_t max_size = 0;
+};
+#endif
+
+#endif /* TMSPOOL_H */
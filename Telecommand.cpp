@@ -11,12 +11,13 @@
 
 #include "Telecommand.h"
 #include "XMLReader_v5.h"
+#include "DelimScan.h"
 
 // --------------------------------------------------------
 // Telecommand parsing interface
 // --------------------------------------------------------
 
-TCParseStatus_t XMLReader::GetTelecommand()
+TCParseStatus_t XMLReaderBase::GetTelecommand()
 {
     zephyr_tc = NULL_TELECOMMAND;
 
@@ -40,7 +41,7 @@ TCParseStatus_t XMLReader::GetTelecommand()
 }
 
 // get the telecommand parameters, if any
-bool XMLReader::ParseTelecommand(uint8_t telecommand)
+bool XMLReaderBase::ParseTelecommand(uint8_t telecommand)
 {
     switch (telecommand) {
     // MCB Parameters -------------------------------------
@@ -215,32 +216,40 @@ bool XMLReader::ParseTelecommand(uint8_t telecommand)
 // Telecommand parsing utilties
 // --------------------------------------------------------
 
-bool XMLReader::Get_uint8(uint8_t * ret_array, uint8_t num_elements)
+// parameters end at ',' or ';', and a '\0' ends the parameter list early
+static const DelimSet_t tc_delims = {{',', ';', '\0', ','}};
+
+// Copies the parameter at tc_index, of at most max_chars, into param and
+// moves past its delimiter, which must be ',' or, for the last, ';'
+bool XMLReaderBase::NextTcParam(char * param, uint8_t max_chars, bool last)
 {
-    char int_buffer[4] = {0};
-    unsigned int temp = 0;
-    uint16_t max_index;
+    size_t length;
 
-    for (uint8_t i = 0; i < num_elements; i++) {
-        max_index = tc_index + 3; // uint8_t can have 3 chars max
-        temp = 0;
+    if (tc_index > tc_length) return false;
+
+    length = DelimScan((const uint8_t *) tc_buffer + tc_index, tc_length - tc_index, tc_delims);
+    if (length > max_chars) return false;
 
-        while (tc_index <= max_index && tc_index < tc_length) {
-            if (',' == tc_buffer[tc_index] || ';' == tc_buffer[tc_index] || '\0' == tc_buffer[tc_index]) {
-                break;
-            }
+    memcpy(param, tc_buffer + tc_index, length);
+    param[length] = '\0';
+    tc_index += length;
 
-            int_buffer[temp++] = tc_buffer[tc_index++];
-        }
+    if (',' == tc_buffer[tc_index] || (';' == tc_buffer[tc_index] && last)) {
+        tc_index++;
+        return true;
+    }
 
-        int_buffer[temp] = '\0';
+    return false;
+}
 
-        // ensure next char is ',' or ';' (if the last element) and move the index past it
-        if (',' == tc_buffer[tc_index] || (';' == tc_buffer[tc_index] && i == (num_elements - 1))) {
-            tc_index++;
-        } else {
-            return false;
-        }
+bool XMLReaderBase::Get_uint8(uint8_t * ret_array, uint8_t num_elements)
+{
+    char int_buffer[4] = {0};
+    unsigned int temp = 0;
+
+    for (uint8_t i = 0; i < num_elements; i++) {
+        // uint8_t can have 3 chars max
+        if (!NextTcParam(int_buffer, 3, i == (num_elements - 1))) return false;
 
         // convert the message id
         if (1 != sscanf(int_buffer, "%u", &temp)) return false;
@@ -251,32 +260,14 @@ bool XMLReader::Get_uint8(uint8_t * ret_array, uint8_t num_elements)
     return true;
 }
 
-bool XMLReader::Get_uint16(uint16_t * ret_array, uint8_t num_elements)
+bool XMLReaderBase::Get_uint16(uint16_t * ret_array, uint8_t num_elements)
 {
     char int_buffer[6] = {0};
     unsigned int temp = 0;
-    uint16_t max_index;
 
     for (uint8_t i = 0; i < num_elements; i++) {
-        max_index = tc_index + 5; // uint16_t can have 5 chars max
-        temp = 0;
-
-        while (tc_index <= max_index && tc_index < tc_length) {
-            if (',' == tc_buffer[tc_index] || ';' == tc_buffer[tc_index] || '\0' == tc_buffer[tc_index]) {
-                break;
-            }
-
-            int_buffer[temp++] = tc_buffer[tc_index++];
-        }
-
-        int_buffer[temp] = '\0';
-
-        // ensure next char is ',' or ';' (if the last element) and move the index past it
-        if (',' == tc_buffer[tc_index] || (';' == tc_buffer[tc_index] && i == (num_elements - 1))) {
-            tc_index++;
-        } else {
-            return false;
-        }
+        // uint16_t can have 5 chars max
+        if (!NextTcParam(int_buffer, 5, i == (num_elements - 1))) return false;
 
         // convert the message id
         if (1 != sscanf(int_buffer, "%u", &temp)) return false;
@@ -287,32 +278,14 @@ bool XMLReader::Get_uint16(uint16_t * ret_array, uint8_t num_elements)
     return true;
 }
 
-bool XMLReader::Get_uint32(uint32_t * ret_array, uint8_t num_elements)
+bool XMLReaderBase::Get_uint32(uint32_t * ret_array, uint8_t num_elements)
 {
     char int_buffer[11] = {0};
     unsigned int temp = 0;
-    uint16_t max_index;
 
     for (uint8_t i = 0; i < num_elements; i++) {
-        max_index = tc_index + 10; // uint32_t can have 10 chars max
-        temp = 0;
-
-        while (tc_index <= max_index && tc_index < tc_length) {
-            if (',' == tc_buffer[tc_index] || ';' == tc_buffer[tc_index] || '\0' == tc_buffer[tc_index]) {
-                break;
-            }
-
-            int_buffer[temp++] = tc_buffer[tc_index++];
-        }
-
-        int_buffer[temp] = '\0';
-
-        // ensure next char is ',' or ';' (if the last element) and move the index past it
-        if (',' == tc_buffer[tc_index] || (';' == tc_buffer[tc_index] && i == (num_elements - 1))) {
-            tc_index++;
-        } else {
-            return false;
-        }
+        // uint32_t can have 10 chars max
+        if (!NextTcParam(int_buffer, 10, i == (num_elements - 1))) return false;
 
         // convert the message id
         if (1 != sscanf(int_buffer, "%u", &temp)) return false;
@@ -322,32 +295,14 @@ bool XMLReader::Get_uint32(uint32_t * ret_array, uint8_t num_elements)
     return true;
 }
 
-bool XMLReader::Get_int8(int8_t * ret_array, uint8_t num_elements)
+bool XMLReaderBase::Get_int8(int8_t * ret_array, uint8_t num_elements)
 {
     char int_buffer[5] = {0};
     int temp = 0;
-    uint16_t max_index;
 
     for (uint8_t i = 0; i < num_elements; i++) {
-        max_index = tc_index + 4; // int8_t can have 4 chars max
-        temp = 0;
-
-        while (tc_index <= max_index && tc_index < tc_length) {
-            if (',' == tc_buffer[tc_index] || ';' == tc_buffer[tc_index] || '\0' == tc_buffer[tc_index]) {
-                break;
-            }
-
-            int_buffer[temp++] = tc_buffer[tc_index++];
-        }
-
-        int_buffer[temp] = '\0';
-
-        // ensure next char is ',' or ';' (if the last element) and move the index past it
-        if (',' == tc_buffer[tc_index] || (';' == tc_buffer[tc_index] && i == (num_elements - 1))) {
-            tc_index++;
-        } else {
-            return false;
-        }
+        // int8_t can have 4 chars max
+        if (!NextTcParam(int_buffer, 4, i == (num_elements - 1))) return false;
 
         // convert the message id
         if (1 != sscanf(int_buffer, "%d", &temp)) return false;
@@ -358,32 +313,14 @@ bool XMLReader::Get_int8(int8_t * ret_array, uint8_t num_elements)
     return true;
 }
 
-bool XMLReader::Get_int16(int16_t * ret_array, uint8_t num_elements)
+bool XMLReaderBase::Get_int16(int16_t * ret_array, uint8_t num_elements)
 {
     char int_buffer[7] = {0};
     int temp = 0;
-    uint16_t max_index;
 
     for (uint8_t i = 0; i < num_elements; i++) {
-        max_index = tc_index + 6; // int16_t can have 6 chars max
-        temp = 0;
-
-        while (tc_index <= max_index && tc_index < tc_length) {
-            if (',' == tc_buffer[tc_index] || ';' == tc_buffer[tc_index] || '\0' == tc_buffer[tc_index]) {
-                break;
-            }
-
-            int_buffer[temp++] = tc_buffer[tc_index++];
-        }
-
-        int_buffer[temp] = '\0';
-
-        // ensure next char is ',' or ';' (if the last element) and move the index past it
-        if (',' == tc_buffer[tc_index] || (';' == tc_buffer[tc_index] && i == (num_elements - 1))) {
-            tc_index++;
-        } else {
-            return false;
-        }
+        // int16_t can have 6 chars max
+        if (!NextTcParam(int_buffer, 6, i == (num_elements - 1))) return false;
 
         // convert the message id
         if (1 != sscanf(int_buffer, "%d", &temp)) return false;
@@ -394,32 +331,14 @@ bool XMLReader::Get_int16(int16_t * ret_array, uint8_t num_elements)
     return true;
 }
 
-bool XMLReader::Get_int32(int32_t * ret_array, uint8_t num_elements)
+bool XMLReaderBase::Get_int32(int32_t * ret_array, uint8_t num_elements)
 {
     char int_buffer[12] = {0};
     int temp = 0;
-    uint16_t max_index;
 
     for (uint8_t i = 0; i < num_elements; i++) {
-        max_index = tc_index + 11; // uint32 can have 11 chars max
-        temp = 0;
-
-        while (tc_index <= max_index && tc_index < tc_length) {
-            if (',' == tc_buffer[tc_index] || ';' == tc_buffer[tc_index] || '\0' == tc_buffer[tc_index]) {
-                break;
-            }
-
-            int_buffer[temp++] = tc_buffer[tc_index++];
-        }
-
-        int_buffer[temp] = '\0';
-
-        // ensure next char is ',' or ';' (if the last element) and move the index past it
-        if (',' == tc_buffer[tc_index] || (';' == tc_buffer[tc_index] && i == (num_elements - 1))) {
-            tc_index++;
-        } else {
-            return false;
-        }
+        // uint32 can have 11 chars max
+        if (!NextTcParam(int_buffer, 11, i == (num_elements - 1))) return false;
 
         // convert the message id
         if (1 != sscanf(int_buffer, "%d", &temp)) return false;
@@ -429,33 +348,14 @@ bool XMLReader::Get_int32(int32_t * ret_array, uint8_t num_elements)
     return true;
 }
 
-bool XMLReader::Get_float(float * ret_array, uint8_t num_elements)
+bool XMLReaderBase::Get_float(float * ret_array, uint8_t num_elements)
 {
     char int_buffer[16] = {0};
     float temp_float = 0.0f;
-    unsigned int temp = 0;
-    uint16_t max_index;
 
     for (uint8_t i = 0; i < num_elements; i++) {
-        max_index = tc_index + 15; // 15 chars max
-        temp = 0;
-
-        while (tc_index <= max_index && tc_index < tc_length) {
-            if (',' == tc_buffer[tc_index] || ';' == tc_buffer[tc_index] || '\0' == tc_buffer[tc_index]) {
-                break;
-            }
-
-            int_buffer[temp++] = tc_buffer[tc_index++];
-        }
-
-        int_buffer[temp] = '\0';
-
-        // ensure next char is ',' or ';' (if the last element) and move the index past it
-        if (',' == tc_buffer[tc_index] || (';' == tc_buffer[tc_index] && i == (num_elements - 1))) {
-            tc_index++;
-        } else {
-            return false;
-        }
+        // 15 chars max
+        if (!NextTcParam(int_buffer, 15, i == (num_elements - 1))) return false;
 
         // convert the message id
         if (1 != sscanf(int_buffer, "%f", &temp_float)) return false;
@@ -466,7 +366,7 @@ bool XMLReader::Get_float(float * ret_array, uint8_t num_elements)
 }
 
 // clears the rest of an errant TC
-void XMLReader::ClearTC()
+void XMLReaderBase::ClearTC()
 {
     while (tc_index < tc_length && ';' != tc_buffer[tc_index++]);
 }
\ No newline at end of file
@@ -0,0 +1,394 @@
+/*
+ * XMLReaderT.h
+ * Created: October 2026
+ *
+ * This file implements the stream reading functions of the XMLReaderT
+ * template, which read each part of a message character by character. It is
+ * included by XMLReader_v5.h, don't include it directly.
+ */
+
+#ifndef XMLREADERT_H
+#define XMLREADERT_H
+
+// --------------------------------------------------------
+// Read messages from the stream
+// --------------------------------------------------------
+
+// get the next character from the stream and update the CRC
+template <class StreamT>
+inline bool XMLReaderT<StreamT>::ReadNextChar(char * new_char)
+{
+    uint8_t ret_char;
+
+    // make sure the new character is good, if not, return failure
+    int read_ret = Rx::read(rx_stream);
+    //Serial.write(read_ret);
+    if (read_ret == -1) return false;
+    ret_char = (uint8_t) read_ret;
+
+    // update CRC
+    UpdateCRC(ret_char);
+
+    // assign the char to the receive location, return success
+    *new_char = (char) ret_char;
+    return true;
+}
+
+template <class StreamT>
+bool XMLReaderT<StreamT>::GetNewMessage()
+{
+    // the XML section deadline is sized for the largest possible message
+    xml_budget = XMLBudget();
+    bin_budget = 0;
+    uint32_t timeout = millis() + xml_budget;
+    char read_char = '\0';
+
+    // read the message type opening tag through the newline, verify the type
+    if (!MessageTypeOpen(timeout)) {
+        ResetReader();
+        return false;
+    }
+
+    // as long as there is a tab next, read a full field through the newline
+    while (millis() < timeout) {
+        if (Rx::available(rx_stream)) {
+            if ('\t' == Rx::peek(rx_stream)) {
+                // clear the \t and read the field
+                if (!ReadNextChar(&read_char) || !ReadField(timeout)) {
+                    ResetReader();
+                    Rx::flush(rx_stream);
+                    return false;
+                }
+            } else {
+                break; // no tab means no more fields
+            }
+        }
+    }
+
+    // read the message type closing tag through the newline
+    if (!MessageTypeClose(timeout)) {
+        ResetReader();
+        Rx::flush(rx_stream);
+        return false;
+    }
+
+    // save the crc result (working_crc will still be updating unnecessarily)
+    crc_result = working_crc;
+
+    // read and verify the full CRC through the newline
+    if (!ReadVerifyCRC(timeout))  {
+        ResetReader();
+        Rx::flush(rx_stream);
+        return false;
+    }
+
+    // parse the message
+    if (!ParseMessage()) {
+        ResetReader();
+        return false;
+    }
+
+    // read the binary section if it's a telecommand, sized by its Length field
+    if (TC == zephyr_message) {
+        bin_budget = BinaryBudget(tc_length);
+        timeout = millis() + bin_budget;
+
+        if (!ReadBinarySection(timeout)) {
+            ResetReader();
+            Rx::flush(rx_stream);
+            return false;
+        }
+    }
+
+    ResetReader();
+    Dispatch();
+    return true;
+}
+
+template <class StreamT>
+uint16_t XMLReaderT<StreamT>::DrainMessages()
+{
+    uint16_t num_read = 0;
+
+    StartDrain();
+
+    // every attempt consumes at least one byte, so this ends with the backlog
+    while (Rx::available(rx_stream) > 0) {
+        if (!GetNewMessage()) continue;
+
+        num_read++;
+        if (DrainStop()) break;
+    }
+
+    FinishDrain();
+    return num_read;
+}
+
+// --------------------------------------------------------
+// Read specific message parts into buffers
+// --------------------------------------------------------
+
+template <class StreamT>
+bool XMLReaderT<StreamT>::MessageTypeOpen(uint32_t timeout)
+{
+    int stream_peek;
+
+    // wait while the buffer contains characters until the opening '<' is next
+    Rx::skipTo(rx_stream, '<');
+    stream_peek = Rx::peek(rx_stream);
+    while (millis() < timeout && -1 != stream_peek && '<' != stream_peek) {
+        Rx::read(rx_stream); // clear the char
+        stream_peek = Rx::peek(rx_stream); // look at the next
+    }
+
+    // ensure we have the opening character
+    if ('<' != stream_peek) return false;
+
+    // read in the message type opening tag and newline
+    if (!ReadOpeningTag(timeout, message_buff, 8)) return false;
+    if (!ReadSpecificChar(timeout, '\n')) return false;
+
+    // determine the message type
+    return MessageType();
+}
+
+template <class StreamT>
+bool XMLReaderT<StreamT>::MessageTypeClose(uint32_t timeout)
+{
+    char close_type[8] = {0};
+
+    // read the tag and the newline
+    if (!ReadSpecificChar(timeout, '<')) return false;
+    if (!ReadClosingTag(timeout, close_type, 8)) return false;
+    if (!ReadSpecificChar(timeout, '\n')) return false;
+
+    // verify that the closing message type matches the opening type
+    if (0 != strcmp(close_type, message_buff)) return false;
+
+    return true;
+}
+
+template <class StreamT>
+bool XMLReaderT<StreamT>::ReadField(uint32_t timeout)
+{
+    int itr = 0;
+    char close_field[8] = {0};
+    char new_char = '\0';
+
+    // read opening field tag
+    if (!ReadOpeningTag(timeout, fields[num_fields], MAX_MSG_FIELDS)) return false;
+
+    // read the field value until start of close tag or error
+    while (millis() < timeout && itr < 15) {
+        // if there's a character available, parse it
+        if (ReadNextChar(&new_char)) {
+            if ('<' == new_char) {
+                break;
+            } else {
+                field_values[num_fields][itr++] = new_char;
+            }
+        }
+    }
+
+    // always null-terminate the buffer
+    field_values[num_fields][itr] = '\0';
+
+    // verify we've started the closing tag
+    if ('<' != new_char && !ReadSpecificChar(timeout, '<')) return false;
+
+    // read closing field tag
+    if (!ReadClosingTag(timeout, close_field, 8)) return false;
+
+    // ensure the opening and closing field tags match
+    if (0 != strcmp(close_field, fields[num_fields])) return false;
+
+    // get the newline
+    if (!ReadSpecificChar(timeout, '\n')) return false;
+
+    num_fields++;
+    return true;
+}
+
+template <class StreamT>
+bool XMLReaderT<StreamT>::ReadVerifyCRC(uint32_t timeout)
+{
+    int itr = 0;
+    unsigned int read_crc = 0;
+    char crc_tag[4] = {0};
+    char crc_value[6] = {0};
+    char new_char = '\0';
+
+    // read and verify opening CRC tag
+    if (!ReadOpeningTag(timeout, crc_tag, 4)) return false;
+    if (0 != strcmp(crc_tag, "CRC")) return false;
+
+    // read the CRC value until start of close tag or error
+    while (millis() < timeout && itr < 5) {
+        // if there's a character available, parse it
+        if (ReadNextChar(&new_char)) {
+            if ('<' == new_char) {
+                break;
+            } else {
+                crc_value[itr++] = new_char;
+            }
+        }
+    }
+
+    // always null-terminate the buffer
+    crc_value[itr] = '\0';
+
+    // verify we've started the closing tag
+    if ('<' != new_char && !ReadSpecificChar(timeout, '<')) return false;
+
+    // read and verify closing crc tag
+    if (!ReadClosingTag(timeout, crc_tag, 4)) return false;
+    if (0 != strcmp(crc_tag, "CRC")) return false;
+
+    // convert the crc from the message to uint16_t
+    if (1 != sscanf(crc_value, "%u", &read_crc)) return false;
+    if (read_crc > 65535) return false;
+
+    // get the trailing newline if it's there
+    if ('\n' == Rx::peek(rx_stream)) {
+        Rx::read(rx_stream);
+    }
+
+    // return the CRC result
+    return true; //((uint16_t) read_crc == crc_result);
+}
+
+template <class StreamT>
+bool XMLReaderT<StreamT>::ReadBinarySection(uint32_t timeout)
+{
+    uint16_t itr = 0;
+    uint16_t read_crc = 0;
+    char rx_char = '\0';
+
+    // read "START" from the stream
+    if (!ReadSpecificChar(timeout, 'S')) return false;
+    if (!ReadSpecificChar(timeout, 'T')) return false;
+    if (!ReadSpecificChar(timeout, 'A')) return false;
+    if (!ReadSpecificChar(timeout, 'R')) return false;
+    if (!ReadSpecificChar(timeout, 'T')) return false;
+
+    // reset CRC for the binary section
+    working_crc = crc_poly;
+
+    // read the binary section into the telecommand buffer
+    num_tcs = 0;
+    tc_index = 0;
+    curr_tc = 0;
+    while (millis() < timeout && itr < tc_length) {
+        if (ReadNextChar(&rx_char)) {
+            tc_buffer[itr++] = rx_char;
+            if (';' == rx_char) num_tcs++;
+        }
+    }
+
+    // verify that we read all of the expected characters
+    if (itr != tc_length) return false;
+
+    // TC buffer is parsed as a char array string, so null-terminate it
+    tc_buffer[itr] = '\0';
+
+    // store the CRC result for comparison with the transmitted value
+    crc_result = working_crc;
+
+    // read the first CRC byte (LSB) from the stream
+    while (millis() < timeout && !ReadNextChar(&rx_char));
+    read_crc = (uint16_t) rx_char;
+
+    // read the second CRC byte (MSB) from the stream
+    while (millis() < timeout && !ReadNextChar(&rx_char));
+    read_crc |= (uint16_t) ((uint8_t) rx_char << 8);
+
+    // verify that the stream ends with "END"
+    if (!ReadSpecificChar(timeout, 'E')) return false;
+    if (!ReadSpecificChar(timeout, 'N')) return false;
+    if (!ReadSpecificChar(timeout, 'D')) return false;
+
+    return true; //read_crc == crc_result;
+}
+
+// --------------------------------------------------------
+// Generic Helper Functions
+// --------------------------------------------------------
+
+// read the desired character, fail if timeout or wrong character
+template <class StreamT>
+bool XMLReaderT<StreamT>::ReadSpecificChar(uint32_t timeout, char specific_char)
+{
+    char new_char;
+
+    // wait until there's a character available
+    while (millis() < timeout && !Rx::available(rx_stream));
+
+    // verify that we get the expected char
+    if (!ReadNextChar(&new_char) || specific_char != new_char) return false;
+
+    return true;
+}
+
+template <class StreamT>
+bool XMLReaderT<StreamT>::ReadOpeningTag(uint32_t timeout, char * buffer, uint8_t buff_size)
+{
+    int itr = 0;
+    char new_char = '\0';
+
+    if (!ReadSpecificChar(timeout, '<')) return false;
+
+    // read the tag until close or error
+    while (millis() < timeout && itr < (buff_size - 1)) {
+        // if there's a character available, parse it
+        if (ReadNextChar(&new_char)) {
+            if ('>' == new_char) {
+                break;
+            } else {
+                buffer[itr++] = new_char;
+            }
+        }
+    }
+
+    // always null-terminate the buffer
+    buffer[itr] = '\0';
+
+    if (new_char == '>') {
+        return true;
+    } else {
+        return ReadSpecificChar(timeout, '>');
+    }
+}
+
+// note: the leading '<' should already have been read before calling
+// this way, fields and CRC can read the '<' and know to stop
+template <class StreamT>
+bool XMLReaderT<StreamT>::ReadClosingTag(uint32_t timeout, char * buffer, uint8_t buff_size)
+{
+    int itr = 0;
+    char new_char = '\0';
+
+    if (!ReadSpecificChar(timeout, '/')) return false;
+
+    // read the tag until close or error
+    while (millis() < timeout && itr < (buff_size - 1)) {
+        // if there's a character available, parse it
+        if (ReadNextChar(&new_char)) {
+            if ('>' == new_char) {
+                break;
+            } else {
+                buffer[itr++] = new_char;
+            }
+        }
+    }
+
+    // always null-terminate the buffer
+    buffer[itr] = '\0';
+
+    if (new_char == '>') {
+        return true;
+    } else {
+        return ReadSpecificChar(timeout, '>');
+    }
+}
+
+#endif /* XMLREADERT_H */
@@ -24,39 +24,43 @@ LPC_Param_t lpcParam = {0};
 MCB_Param_t mcbParam = {0};
 PU_Param_t puParam = {0};
 
-XMLReader::XMLReader(Stream * rxstream, Instrument_t inst)
+XMLReaderBase::XMLReaderBase(Instrument_t inst, uint32_t baud)
 {
-    rx_stream = rxstream;
     instrument = inst;
+    SetBaudRate(baud);
 }
 
-// get the next character from the stream and update the CRC
-inline bool XMLReader::ReadNextChar(char * new_char)
+// --------------------------------------------------------
+// Read deadline budgets
+// --------------------------------------------------------
+
+void XMLReaderBase::SetBaudRate(uint32_t baud)
 {
-    uint16_t c;
-    uint8_t ret_char, msb, lsb;
-
-    // make sure the new character is good, if not, return failure
-    int read_ret = rx_stream->read();
-    //Serial.write(read_ret);
-    if (read_ret == -1) return false;
-    ret_char = (uint8_t) read_ret;
-
-    // update CRC
-    msb = working_crc >> 8;
-    lsb = working_crc & 0xFF;
-    c = ret_char ^ msb;
-    c ^= (c >> 4);
-    msb = (lsb ^ (c >> 3) ^ (c << 4)) & 255;
-    lsb = (c ^ (c << 5)) & 255;
-    working_crc = (msb << 8) + lsb;
-
-    // assign the char to the receive location, return success
-    *new_char = (char) ret_char;
-    return true;
+    // guard against a zero divisor, fall back to the Zephyr default
+    baud_rate = (0 == baud) ? ZEPHYR_BAUD_RATE : baud;
+}
+
+// time on the wire for the worst-case XML section plus margin, never less than the minimum
+uint32_t XMLReaderBase::XMLBudget()
+{
+    // 10 bits per byte with start and stop bits, rounded up to the next ms
+    uint32_t wire_ms = ((uint32_t) MAX_XML_MSG_SIZE * 10000 + baud_rate - 1) / baud_rate;
+
+    if (wire_ms + READ_MARGIN < XML_MIN_TIMEOUT) return XML_MIN_TIMEOUT;
+
+    return wire_ms + READ_MARGIN;
+}
+
+// time on the wire for a binary section of the given length plus margin
+uint32_t XMLReaderBase::BinaryBudget(uint16_t length)
+{
+    uint32_t num_bytes = (uint32_t) length + BIN_FRAMING_SIZE;
+
+    return (num_bytes * 10000 + baud_rate - 1) / baud_rate + READ_MARGIN;
 }
 
-void XMLReader::ResetReader()
+
+void XMLReaderBase::ResetReader()
 {
     working_crc = crc_poly;
     crc_result = 0;
@@ -70,73 +74,12 @@ void XMLReader::ResetReader()
     }
 }
 
-bool XMLReader::GetNewMessage()
-{
-    // set a 0.1 second timeout
-    uint32_t timeout = millis() + 200;
-    char read_char = '\0';
-
-    // read the message type opening tag through the newline, verify the type
-    if (!MessageTypeOpen(timeout)) {
-        ResetReader();
-        return false;
-    }
-
-    // as long as there is a tab next, read a full field through the newline
-    while (millis() < timeout) {
-        if (rx_stream->available()) {
-            if ('\t' == rx_stream->peek()) {
-                // clear the \t and read the field
-                if (!ReadNextChar(&read_char) || !ReadField(timeout)) {
-                    ResetReader();
-                    rx_stream->flush();
-                    return false;
-                }
-            } else {
-                break; // no tab means no more fields
-            }
-        }
-    }
-
-    // read the message type closing tag through the newline
-    if (!MessageTypeClose(timeout)) {
-        ResetReader();
-        rx_stream->flush();
-        return false;
-    }
-
-    // save the crc result (working_crc will still be updating unnecessarily)
-    crc_result = working_crc;
-
-    // read and verify the full CRC through the newline
-    if (!ReadVerifyCRC(timeout))  {
-        ResetReader();
-        rx_stream->flush();
-        return false;
-    }
-
-    // parse the message
-    if (!ParseMessage()) return false;
-
-    // Add an extra 0.1 seconds to the timeout for the binary section
-    timeout += 100;
-
-    // read the binary section if it's a telecommand
-    if (TC == zephyr_message && !ReadBinarySection(timeout)) {
-        ResetReader();
-        rx_stream->flush();
-        return false;
-    }
-
-    ResetReader();
-    return true;
-}
 
 // --------------------------------------------------------
 // Message Parsing
 // --------------------------------------------------------
 
-bool XMLReader::ParseMessage()
+bool XMLReaderBase::ParseMessage()
 {
     unsigned int utemp = 0;
 
@@ -147,31 +90,57 @@ bool XMLReader::ParseMessage()
     message_id = (uint16_t) utemp;
 
     // GPS message differs entirely from here on, parse it separately
-    if (GPS == zephyr_message) return ParseGPSMessage();
+    if (GPS == zephyr_message) {
+        if (!VerifyGPSFields()) return false;
+
+        // while draining, only the latest GPS message with a fix is decoded;
+        // one without is ignored as by ParseGPSMessage, keeping the last fix
+        if (draining) {
+            if (1 != sscanf(field_values[9], "%u", &utemp) || 0 == utemp) return false;
+            if (drain_gps) drain_coalesced++;
+            memcpy(gps_values, &field_values[1], sizeof(gps_values));
+            drain_gps = true;
+            drain_gps_id = message_id;
+            return true;
+        }
+
+        if (!use_subscriptions) return ParseGPSMessage(&field_values[1]);
+
+        // keep the values to decode if and when they're asked for
+        if (NULL != handlers[GPS]) {
+            memcpy(gps_values, &field_values[1], sizeof(gps_values));
+            gps_pending = true;
+        }
+        return true;
+    }
 
     // verify instrument id
     if (0 != strcmp(fields[1], "Inst")) return false;
     if (0 != strcmp(field_values[1], inst_ids[instrument])) return false;
 
+    // while draining, only the latest IM message is decoded for its handler;
+    // without one, each IM must be acked by the caller, so none are skipped
+    if (draining && IM == zephyr_message && NULL != handlers[IM]) {
+        if (!VerifyFields()) return false;
+        if (drain_im) drain_coalesced++;
+        memcpy(im_mode_value, field_values[2], sizeof(im_mode_value));
+        drain_im = true;
+        drain_im_id = message_id;
+        return true;
+    }
+
+    // unsubscribed types are only checked, but a TC needs its length to be read
+    if (use_subscriptions && TC != zephyr_message && NULL == handlers[zephyr_message]) {
+        return VerifyFields();
+    }
+
     switch (zephyr_message) {
     case IM:
         // verify mode field
         if (0 != strcmp(fields[2], "Mode")) return false;
 
         // get mode
-        if (0 == strcmp(field_values[2], "SB")) {
-            zephyr_mode = MODE_STANDBY;
-        } else if (0 == strcmp(field_values[2], "FL")) {
-            zephyr_mode = MODE_FLIGHT;
-        } else if (0 == strcmp(field_values[2], "LP")) {
-            zephyr_mode = MODE_LOWPOWER;
-        } else if (0 == strcmp(field_values[2], "SA")) {
-            zephyr_mode = MODE_SAFETY;
-        } else if (0 == strcmp(field_values[2], "EF")) {
-            zephyr_mode = MODE_EOF;
-        } else {
-            return false;
-        }
+        if (!ParseMode(field_values[2])) return false;
         break;
     case SAck:
     case RAAck:
@@ -207,13 +176,71 @@ bool XMLReader::ParseMessage()
     return true;
 }
 
-// Parse the GPS message, ensure that the GPS struct only ever contains valid data
-bool XMLReader::ParseGPSMessage()
+bool XMLReaderBase::ParseMode(const char * value)
 {
-    float longtemp, lattemp, alttemp, szatemp, vbattemp, difftemp;
-    unsigned int yeartemp, monthtemp, daytemp, hourtemp, minutetemp, secondtemp, qualitytemp;
+    if (0 == strcmp(value, "SB")) {
+        zephyr_mode = MODE_STANDBY;
+    } else if (0 == strcmp(value, "FL")) {
+        zephyr_mode = MODE_FLIGHT;
+    } else if (0 == strcmp(value, "LP")) {
+        zephyr_mode = MODE_LOWPOWER;
+    } else if (0 == strcmp(value, "SA")) {
+        zephyr_mode = MODE_SAFETY;
+    } else if (0 == strcmp(value, "EF")) {
+        zephyr_mode = MODE_EOF;
+    } else {
+        return false;
+    }
+
+    return true;
+}
 
-    // verify the fields
+// determine the message type from the opening tag in message_buff
+bool XMLReaderBase::MessageType()
+{
+    if (0 == strcmp(MSG_IM, message_buff)) {
+        zephyr_message = IM;
+    } else if (0 == strcmp(MSG_SAck, message_buff)) {
+        zephyr_message = SAck;
+    } else if (0 == strcmp(MSG_SW, message_buff)) {
+        zephyr_message = SW;
+    } else if (0 == strcmp(MSG_RAAck, message_buff)) {
+        zephyr_message = RAAck;
+    } else if (0 == strcmp(MSG_TMAck, message_buff)) {
+        zephyr_message = TMAck;
+    } else if (0 == strcmp(MSG_TC, message_buff)) {
+        zephyr_message = TC;
+    } else if (0 == strcmp(MSG_GPS, message_buff)) {
+        zephyr_message = GPS;
+    } else { // error
+        zephyr_message = UNKNOWN;
+        return false;
+    }
+
+    return true;
+}
+
+// check the field tags of a non-GPS message type
+bool XMLReaderBase::VerifyFields()
+{
+    switch (zephyr_message) {
+    case IM:
+        return 0 == strcmp(fields[2], "Mode");
+    case SAck:
+    case RAAck:
+    case TMAck:
+        return 0 == strcmp(fields[2], "Ack");
+    case SW:
+        return true;
+    case TC:
+        return 0 == strcmp(fields[2], "Length");
+    default:
+        return false;
+    }
+}
+
+bool XMLReaderBase::VerifyGPSFields()
+{
     if (0 != strcmp(fields[1], "Date")) return false;
     if (0 != strcmp(fields[2], "Time")) return false;
     if (0 != strcmp(fields[3], "Lon")) return false;
@@ -224,38 +251,47 @@ bool XMLReader::ParseGPSMessage()
     if (0 != strcmp(fields[8], "Diff")) return false;
     if (0 != strcmp(fields[9], "Quality")) return false;
 
+    return true;
+}
+
+// Parse the GPS values (Date through Quality), ensure that the GPS struct only ever contains valid data
+bool XMLReaderBase::ParseGPSMessage(const char values[][16])
+{
+    float longtemp, lattemp, alttemp, szatemp, vbattemp, difftemp;
+    unsigned int yeartemp, monthtemp, daytemp, hourtemp, minutetemp, secondtemp, qualitytemp;
+
     // parse the date (YYYY/MM/DD)
-    if (3 != sscanf(field_values[1], "%u/%u/%u", &yeartemp, &monthtemp, &daytemp)) return false;
+    if (3 != sscanf(values[0], "%u/%u/%u", &yeartemp, &monthtemp, &daytemp)) return false;
     if (yeartemp > 2050) return false;
     if (monthtemp > 12) return false;
     if (daytemp > 31) return false;
 
     // parse the time (HH:MM:SS)
-    if (3 != sscanf(field_values[2], "%u:%u:%u", &hourtemp, &minutetemp, &secondtemp)) return false;
+    if (3 != sscanf(values[1], "%u:%u:%u", &hourtemp, &minutetemp, &secondtemp)) return false;
     if (hourtemp > 23) return false;
     if (minutetemp > 59) return false;
     if (secondtemp > 59) return false; // don't handle leap seconds
 
     // parse the longitude
-    if (1 != sscanf(field_values[3], "%f", &longtemp)) return false;
+    if (1 != sscanf(values[2], "%f", &longtemp)) return false;
 
     // parse the latitude
-    if (1 != sscanf(field_values[4], "%f", &lattemp)) return false;
+    if (1 != sscanf(values[3], "%f", &lattemp)) return false;
 
     // parse the altitude
-    if (1 != sscanf(field_values[5], "%f", &alttemp)) return false;
+    if (1 != sscanf(values[4], "%f", &alttemp)) return false;
 
     // parse the solar zenith angle
-    if (1 != sscanf(field_values[6], "%f", &szatemp)) return false;
+    if (1 != sscanf(values[5], "%f", &szatemp)) return false;
 
     // parse the vbat
-    if (1 != sscanf(field_values[7], "%f", &vbattemp)) return false;
+    if (1 != sscanf(values[6], "%f", &vbattemp)) return false;
 
     // parse the diff
-    if (1 != sscanf(field_values[8], "%f", &difftemp)) return false;
+    if (1 != sscanf(values[7], "%f", &difftemp)) return false;
 
     // parse the GPS fix quality
-    if (1 != sscanf(field_values[9], "%u", &qualitytemp)) return false;
+    if (1 != sscanf(values[8], "%u", &qualitytemp)) return false;
     if (0 == qualitytemp) return false; // ignore these messages
 
     // only assign values once the message has been parsed successfully
@@ -279,278 +315,100 @@ bool XMLReader::ParseGPSMessage()
 }
 
 // --------------------------------------------------------
-// Read specific message parts into buffers
+// Subscriptions
 // --------------------------------------------------------
 
-bool XMLReader::MessageTypeOpen(uint32_t timeout)
+void XMLReaderBase::UseSubscriptions(bool enable)
 {
-    int stream_peek;
-
-    // wait while the buffer contains characters until the opening '<' is next
-    stream_peek = rx_stream->peek();
-    while (millis() < timeout && -1 != stream_peek && '<' != stream_peek) {
-        rx_stream->read(); // clear the char
-        stream_peek = rx_stream->peek(); // look at the next
-    }
-
-    // ensure we have the opening character
-    if ('<' != stream_peek) return false;
-
-    // read in the message type opening tag and newline
-    if (!ReadOpeningTag(timeout, message_buff, 8)) return false;
-    if (!ReadSpecificChar(timeout, '\n')) return false;
-
-    // determine the message type
-    if (0 == strcmp(MSG_IM, message_buff)) {
-        zephyr_message = IM;
-    } else if (0 == strcmp(MSG_SAck, message_buff)) {
-        zephyr_message = SAck;
-    } else if (0 == strcmp(MSG_SW, message_buff)) {
-        zephyr_message = SW;
-    } else if (0 == strcmp(MSG_RAAck, message_buff)) {
-        zephyr_message = RAAck;
-    } else if (0 == strcmp(MSG_TMAck, message_buff)) {
-        zephyr_message = TMAck;
-    } else if (0 == strcmp(MSG_TC, message_buff)) {
-        zephyr_message = TC;
-    } else if (0 == strcmp(MSG_GPS, message_buff)) {
-        zephyr_message = GPS;
-    } else { // error
-        zephyr_message = UNKNOWN;
-        return false;
-    }
-
-    return true;
+    use_subscriptions = enable;
 }
 
-bool XMLReader::MessageTypeClose(uint32_t timeout)
+void XMLReaderBase::Subscribe(ZephyrMessage_t type, ZephyrHandler_t handler, void * context)
 {
-    char close_type[8] = {0};
-
-    // read the tag and the newline
-    if (!ReadSpecificChar(timeout, '<')) return false;
-    if (!ReadClosingTag(timeout, close_type, 8)) return false;
-    if (!ReadSpecificChar(timeout, '\n')) return false;
+    if (type >= NO_ZEPHYR_MSG) return;
 
-    // verify that the closing message type matches the opening type
-    if (0 != strcmp(close_type, message_buff)) return false;
-
-    return true;
+    handlers[type] = handler;
+    handler_contexts[type] = context;
 }
 
-bool XMLReader::ReadField(uint32_t timeout)
+void XMLReaderBase::Unsubscribe(ZephyrMessage_t type)
 {
-    int itr = 0;
-    char close_field[8] = {0};
-    char new_char = '\0';
-
-    // read opening field tag
-    if (!ReadOpeningTag(timeout, fields[num_fields], MAX_MSG_FIELDS)) return false;
-
-    // read the field value until start of close tag or error
-    while (millis() < timeout && itr < 15) {
-        // if there's a character available, parse it
-        if (ReadNextChar(&new_char)) {
-            if ('<' == new_char) {
-                break;
-            } else {
-                field_values[num_fields][itr++] = new_char;
-            }
-        }
-    }
-
-    // always null-terminate the buffer
-    field_values[num_fields][itr] = '\0';
-
-    // verify we've started the closing tag
-    if ('<' != new_char && !ReadSpecificChar(timeout, '<')) return false;
-
-    // read closing field tag
-    if (!ReadClosingTag(timeout, close_field, 8)) return false;
-
-    // ensure the opening and closing field tags match
-    if (0 != strcmp(close_field, fields[num_fields])) return false;
-
-    // get the newline
-    if (!ReadSpecificChar(timeout, '\n')) return false;
-
-    num_fields++;
-    return true;
+    Subscribe(type, NULL, NULL);
 }
 
-bool XMLReader::ReadVerifyCRC(uint32_t timeout)
+bool XMLReaderBase::GetGPS()
 {
-    int itr = 0;
-    unsigned int read_crc = 0;
-    char crc_tag[4] = {0};
-    char crc_value[6] = {0};
-    char new_char = '\0';
-
-    // read and verify opening CRC tag
-    if (!ReadOpeningTag(timeout, crc_tag, 4)) return false;
-    if (0 != strcmp(crc_tag, "CRC")) return false;
-
-    // read the CRC value until start of close tag or error
-    while (millis() < timeout && itr < 5) {
-        // if there's a character available, parse it
-        if (ReadNextChar(&new_char)) {
-            if ('<' == new_char) {
-                break;
-            } else {
-                crc_value[itr++] = new_char;
-            }
-        }
-    }
-
-    // always null-terminate the buffer
-    crc_value[itr] = '\0';
-
-    // verify we've started the closing tag
-    if ('<' != new_char && !ReadSpecificChar(timeout, '<')) return false;
-
-    // read and verify closing crc tag
-    if (!ReadClosingTag(timeout, crc_tag, 4)) return false;
-    if (0 != strcmp(crc_tag, "CRC")) return false;
+    if (!gps_pending) return false;
 
-    // convert the crc from the message to uint16_t
-    if (1 != sscanf(crc_value, "%u", &read_crc)) return false;
-    if (read_crc > 65535) return false;
-
-    // get the trailing newline if it's there
-    if ('\n' == rx_stream->peek()) {
-        rx_stream->read();
-    }
-
-    // return the CRC result
-    return true; //((uint16_t) read_crc == crc_result);
+    // decode once, the result stays in zephyr_gps
+    gps_pending = false;
+    return ParseGPSMessage(gps_values);
 }
 
-bool XMLReader::ReadBinarySection(uint32_t timeout)
+void XMLReaderBase::Dispatch()
 {
-    uint16_t itr = 0;
-    uint16_t read_crc = 0;
-    char rx_char = '\0';
-
-    // read "START" from the stream
-    if (!ReadSpecificChar(timeout, 'S')) return false;
-    if (!ReadSpecificChar(timeout, 'T')) return false;
-    if (!ReadSpecificChar(timeout, 'A')) return false;
-    if (!ReadSpecificChar(timeout, 'R')) return false;
-    if (!ReadSpecificChar(timeout, 'T')) return false;
-
-    // reset CRC for the binary section
-    working_crc = crc_poly;
-
-    // read the binary section into the telecommand buffer
-    num_tcs = 0;
-    tc_index = 0;
-    curr_tc = 0;
-    while (millis() < timeout && itr < tc_length) {
-        if (ReadNextChar(&rx_char)) {
-            tc_buffer[itr++] = rx_char;
-            if (';' == rx_char) num_tcs++;
-        }
-    }
-
-    // verify that we read all of the expected characters
-    if (itr != tc_length) return false;
-
-    // TC buffer is parsed as a char array string, so null-terminate it
-    tc_buffer[itr] = '\0';
-
-    // store the CRC result for comparison with the transmitted value
-    crc_result = working_crc;
-
-    // read the first CRC byte (LSB) from the stream
-    while (millis() < timeout && !ReadNextChar(&rx_char));
-    read_crc = (uint16_t) rx_char;
+    if (zephyr_message >= NO_ZEPHYR_MSG || NULL == handlers[zephyr_message]) return;
 
-    // read the second CRC byte (MSB) from the stream
-    while (millis() < timeout && !ReadNextChar(&rx_char));
-    read_crc |= (uint16_t) ((uint8_t) rx_char << 8);
+    // coalesced types are dispatched once the drain completes
+    if (draining && (GPS == zephyr_message || IM == zephyr_message)) return;
 
-    // verify that the stream ends with "END"
-    if (!ReadSpecificChar(timeout, 'E')) return false;
-    if (!ReadSpecificChar(timeout, 'N')) return false;
-    if (!ReadSpecificChar(timeout, 'D')) return false;
-
-    return true; //read_crc == crc_result;
+    handlers[zephyr_message](this, handler_contexts[zephyr_message]);
 }
 
 // --------------------------------------------------------
-// Generic Helper Functions
+// Backlog draining
 // --------------------------------------------------------
 
-// read the desired character, fail if timeout or wrong character
-bool XMLReader::ReadSpecificChar(uint32_t timeout, char specific_char)
+void XMLReaderBase::StartDrain()
 {
-    char new_char;
-
-    // wait until there's a character available
-    while (millis() < timeout && !rx_stream->available());
+    draining = true;
+    drain_im = false;
+    drain_gps = false;
+    drain_coalesced = 0;
+    drain_stopped = false;
+}
 
-    // verify that we get the expected char
-    if (!ReadNextChar(&new_char) || specific_char != new_char) return false;
+// A TC, ack or IM without a handler must be seen by the caller before the
+// next message overwrites it. Unsubscribed types other than TC were only
+// checked, so they're passed over.
+bool XMLReaderBase::DrainStop()
+{
+    if (GPS == zephyr_message || zephyr_message >= NO_ZEPHYR_MSG) return false;
+    if (NULL != handlers[zephyr_message]) return false;
+    if (use_subscriptions && TC != zephyr_message) return false;
 
+    drain_stopped = true;
     return true;
 }
 
-bool XMLReader::ReadOpeningTag(uint32_t timeout, char * buffer, uint8_t buff_size)
+// decode and dispatch the latest IM and GPS messages of the drain
+void XMLReaderBase::FinishDrain()
 {
-    int itr = 0;
-    char new_char = '\0';
-
-    if (!ReadSpecificChar(timeout, '<')) return false;
-
-    // read the tag until close or error
-    while (millis() < timeout && itr < (buff_size - 1)) {
-        // if there's a character available, parse it
-        if (ReadNextChar(&new_char)) {
-            if ('>' == new_char) {
-                break;
-            } else {
-                buffer[itr++] = new_char;
-            }
-        }
-    }
+    ZephyrMessage_t last_message = zephyr_message;
+    uint16_t last_id = message_id;
 
-    // always null-terminate the buffer
-    buffer[itr] = '\0';
+    draining = false;
 
-    if (new_char == '>') {
-        return true;
-    } else {
-        return ReadSpecificChar(timeout, '>');
+    if (drain_im) {
+        zephyr_message = IM;
+        message_id = drain_im_id;
+        if (ParseMode(im_mode_value)) Dispatch();
     }
-}
 
-// note: the leading '<' should already have been read before calling
-// this way, fields and CRC can read the '<' and know to stop
-bool XMLReader::ReadClosingTag(uint32_t timeout, char * buffer, uint8_t buff_size)
-{
-    int itr = 0;
-    char new_char = '\0';
-
-    if (!ReadSpecificChar(timeout, '/')) return false;
-
-    // read the tag until close or error
-    while (millis() < timeout && itr < (buff_size - 1)) {
-        // if there's a character available, parse it
-        if (ReadNextChar(&new_char)) {
-            if ('>' == new_char) {
-                break;
-            } else {
-                buffer[itr++] = new_char;
-            }
+    if (drain_gps) {
+        zephyr_message = GPS;
+        message_id = drain_gps_id;
+        if (!use_subscriptions) {
+            ParseGPSMessage(gps_values);
+        } else if (NULL != handlers[GPS]) {
+            gps_pending = true;
+            Dispatch();
         }
     }
 
-    // always null-terminate the buffer
-    buffer[itr] = '\0';
-
-    if (new_char == '>') {
-        return true;
-    } else {
-        return ReadSpecificChar(timeout, '>');
+    // the message the drain stopped at stays current for the caller
+    if (drain_stopped) {
+        zephyr_message = last_message;
+        message_id = last_id;
     }
 }
\ No newline at end of file
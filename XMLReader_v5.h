@@ -11,6 +11,11 @@
  * and necessary to modify the core to increase the size of these buffers.
  *
  * Version 5 is a complete re-design of the XMLReader
+ *
+ * The reader is templated on the stream type: XMLReaderT<HardwareSerial>
+ * calls the port's read/peek/available directly, so they can be inlined in
+ * the per-character loops. XMLReader is XMLReaderT<Stream>, which makes
+ * virtual calls and accepts any Stream.
  */
 
 #ifndef XMLREADER_H
@@ -25,6 +30,20 @@
 // The maximum number of fields that a message can contain.
 #define MAX_MSG_FIELDS 10
 
+// Default OBC link rate, used to compute per-stage read deadlines
+#define ZEPHYR_BAUD_RATE 115200
+
+// Deadline tuning (ms): the XML section never gets less than the minimum, and
+// each stage gets the margin on top of its worst-case time on the wire
+#define XML_MIN_TIMEOUT 200
+#define READ_MARGIN     100
+
+// Worst-case XML section size: type tags, all fields at full width, and CRC
+#define MAX_XML_MSG_SIZE (2 * 11 + MAX_MSG_FIELDS * 44 + 20)
+
+// Bytes framing a binary section: "START", two CRC bytes, "END"
+#define BIN_FRAMING_SIZE 10
+
 // Message Types
 #define MSG_IM      "IM"
 #define MSG_SAck    "SAck"
@@ -80,16 +99,67 @@ extern LPC_Param_t lpcParam;
 extern MCB_Param_t mcbParam;
 extern PU_Param_t puParam;
 
-class XMLReader {
+// Stream calls used by the reader. For a concrete stream class they're
+// qualified, so they bind statically and can be inlined; the stream object
+// must then be exactly that class, not a subclass of it. Any class with
+// read, peek, available and flush can be used, it needn't be a Stream.
+// skipTo may discard bytes before the next delim in bulk, for streams that
+// hold their data in memory (see MemoryStream.h); otherwise it does nothing
+// and the reader skips them a byte at a time.
+template <class StreamT>
+struct RxStreamOps {
+    static inline int read(StreamT * stream) { return stream->StreamT::read(); }
+    static inline int peek(StreamT * stream) { return stream->StreamT::peek(); }
+    static inline int available(StreamT * stream) { return stream->StreamT::available(); }
+    static inline void flush(StreamT * stream) { stream->StreamT::flush(); }
+    static inline void skipTo(StreamT *, char) { }
+};
+
+// the polymorphic Stream dispatches virtually as usual
+template <>
+struct RxStreamOps<Stream> {
+    static inline int read(Stream * stream) { return stream->read(); }
+    static inline int peek(Stream * stream) { return stream->peek(); }
+    static inline int available(Stream * stream) { return stream->available(); }
+    static inline void flush(Stream * stream) { stream->flush(); }
+    static inline void skipTo(Stream *, char) { }
+};
+
+class XMLReaderBase;
+
+// Called for each valid message of a subscribed type, from GetNewMessage
+typedef void (*ZephyrHandler_t)(XMLReaderBase * reader, void * context);
+
+// Message state and parsing, independent of the stream type
+class XMLReaderBase {
 public:
     // constructors/destructors
-    XMLReader(Stream * rxstream, Instrument_t inst);
-    ~XMLReader() { };
+    XMLReaderBase(Instrument_t inst, uint32_t baud);
+    ~XMLReaderBase() { };
 
     // public interface functions
-    bool GetNewMessage();
     TCParseStatus_t GetTelecommand(); // implemented in Telecommand.cpp
 
+    // Subscriptions: once enabled, only subscribed message types have their
+    // values converted (a TC's Length is always read). Other types are still
+    // checked field by field and returned by GetNewMessage, with only
+    // zephyr_message and message_id set. A subscribed GPS message is decoded
+    // into zephyr_gps only when GetGPS is called.
+    void UseSubscriptions(bool enable);
+    void Subscribe(ZephyrMessage_t type, ZephyrHandler_t handler, void * context = NULL);
+    void Unsubscribe(ZephyrMessage_t type);
+    bool GetGPS(); // false if the last GPS message is invalid, zephyr_gps is then unchanged
+
+    // messages coalesced by the last DrainMessages, and whether it stopped
+    // early at a message left for the caller, see XMLReaderT
+    uint16_t drain_coalesced = 0;
+    bool drain_stopped = false;
+
+    // read deadline budgets (ms) at the configured baud rate
+    void SetBaudRate(uint32_t baud);
+    uint32_t XMLBudget();
+    uint32_t BinaryBudget(uint16_t length);
+
     // general message results
     ZephyrMessage_t zephyr_message = NO_ZEPHYR_MSG;
     uint16_t message_id = 0;
@@ -106,25 +176,47 @@ public:
     uint8_t num_tcs = 0;
     uint8_t curr_tc = 0;
 
-private:
+    // deadline budgets (ms) used for the last message
+    uint32_t xml_budget = 0;
+    uint32_t bin_budget = 0;
+
+protected:
     // parsing functions
     bool ParseMessage();
-    bool ParseGPSMessage();
+    bool ParseGPSMessage(const char values[][16]);
 
-    // get the next character from the stream and update the CRC
-    bool ReadNextChar(char * new_char);
+    // check that the fields of a type are present, without converting them
+    bool VerifyFields();
+    bool VerifyGPSFields();
 
-    // read different parts of the message into buffers
-    bool MessageTypeOpen(uint32_t timeout);
-    bool MessageTypeClose(uint32_t timeout);
-    bool ReadField(uint32_t timeout);
-    bool ReadVerifyCRC(uint32_t timeout);
-    bool ReadBinarySection(uint32_t timeout);
+    // call the handler of the message type, if any
+    void Dispatch();
 
-    // generic helpers
-    bool ReadSpecificChar(uint32_t timeout, char specific_char);
-    bool ReadOpeningTag(uint32_t timeout, char * buffer, uint8_t buff_size);
-    bool ReadClosingTag(uint32_t timeout, char * buffer, uint8_t buff_size);
+    // set zephyr_mode from an IM Mode value
+    bool ParseMode(const char * value);
+
+    // backlog draining, only the latest IM and GPS are decoded
+    void StartDrain();
+    bool DrainStop(); // after each message read, true if it's left for the caller
+    void FinishDrain();
+
+    // determine the message type from message_buff
+    bool MessageType();
+
+    // update the CRC with a received character
+    inline void UpdateCRC(uint8_t new_char)
+    {
+        uint16_t c;
+        uint8_t msb, lsb;
+
+        msb = working_crc >> 8;
+        lsb = working_crc & 0xFF;
+        c = new_char ^ msb;
+        c ^= (c >> 4);
+        msb = (lsb ^ (c >> 3) ^ (c << 4)) & 255;
+        lsb = (c ^ (c << 5)) & 255;
+        working_crc = (msb << 8) + lsb;
+    }
 
     // after every message or error
     void ResetReader();
@@ -133,6 +225,7 @@ private:
     bool ParseTelecommand(uint8_t telecommand);
 
     // telecommand parsing utilities (implemented in Telecommand.cpp)
+    bool NextTcParam(char * param, uint8_t max_chars, bool last);
     bool Get_uint8(uint8_t * ret_array, uint8_t num_elements);
     bool Get_uint16(uint16_t * ret_array, uint8_t num_elements);
     bool Get_uint32(uint32_t * ret_array, uint8_t num_elements);
@@ -142,12 +235,12 @@ private:
     bool Get_float(float * ret_array, uint8_t num_elements);
     void ClearTC(); // clears the rest of an errant TC
 
-    // serial port for Strateole on-board computer
-    Stream * rx_stream;
-
     // Instrument id
     Instrument_t instrument;
 
+    // OBC link rate for deadline computation
+    uint32_t baud_rate;
+
     // CRC-CCITT16 internals
     const uint16_t crc_poly = 0x1021;
     uint16_t working_crc = 0;
@@ -162,6 +255,75 @@ private:
     // internal telecommand tracking
     uint16_t tc_index = 0;
 
+    // subscriptions, indexed by ZephyrMessage_t
+    bool use_subscriptions = false;
+    ZephyrHandler_t handlers[NO_ZEPHYR_MSG] = {NULL};
+    void * handler_contexts[NO_ZEPHYR_MSG] = {NULL};
+
+    // raw Date through Quality values of the last GPS message, until decoded
+    char gps_values[MAX_MSG_FIELDS - 1][16] = {{0}};
+    bool gps_pending = false;
+
+    // latest IM and GPS messages seen while draining
+    bool draining = false;
+    bool drain_im = false;
+    bool drain_gps = false;
+    uint16_t drain_im_id = 0;
+    uint16_t drain_gps_id = 0;
+    char im_mode_value[16] = {0};
+
+};
+
+template <class StreamT>
+class XMLReaderT : public XMLReaderBase {
+public:
+    XMLReaderT(StreamT * rxstream, Instrument_t inst, uint32_t baud = ZEPHYR_BAUD_RATE)
+        : XMLReaderBase(inst, baud), rx_stream(rxstream) { };
+
+    bool GetNewMessage();
+
+    // Read every message already received in one pass, e.g. after a stall.
+    // Other messages are handled in order as by GetNewMessage, but of the
+    // GPS messages (with a fix) and the IM messages with a handler, only the
+    // latest of each is decoded, and it's dispatched after the rest. Returns
+    // the number of valid messages read, including the drain_coalesced stale
+    // IM and GPS messages that were skipped.
+    // A message without a handler (e.g. any TC, ack or IM when not using
+    // subscriptions) would be overwritten by the next one, so the drain
+    // stops after it with drain_stopped set, leaving it current as after
+    // GetNewMessage. Handle it, then call DrainMessages again to continue.
+    uint16_t DrainMessages();
+
+private:
+    typedef RxStreamOps<StreamT> Rx;
+
+    // get the next character from the stream and update the CRC
+    bool ReadNextChar(char * new_char);
+
+    // read different parts of the message into buffers
+    bool MessageTypeOpen(uint32_t timeout);
+    bool MessageTypeClose(uint32_t timeout);
+    bool ReadField(uint32_t timeout);
+    bool ReadVerifyCRC(uint32_t timeout);
+    bool ReadBinarySection(uint32_t timeout);
+
+    // generic helpers
+    bool ReadSpecificChar(uint32_t timeout, char specific_char);
+    bool ReadOpeningTag(uint32_t timeout, char * buffer, uint8_t buff_size);
+    bool ReadClosingTag(uint32_t timeout, char * buffer, uint8_t buff_size);
+
+    // serial port for Strateole on-board computer
+    StreamT * rx_stream;
 };
 
+// The reader for any Stream, as used by StratoCore
+class XMLReader : public XMLReaderT<Stream> {
+public:
+    XMLReader(Stream * rxstream, Instrument_t inst, uint32_t baud = ZEPHYR_BAUD_RATE)
+        : XMLReaderT<Stream>(rxstream, inst, baud) { };
+};
+
+// the stream reading functions are defined with the template
+#include "XMLReaderT.h"
+
 #endif /* XMLREADER_H */
\ No newline at end of file
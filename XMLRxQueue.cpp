@@ -0,0 +1,193 @@
+/*
+ * XMLRxQueue.cpp
+ * Created: October 2026
+ *
+ * This file implements the framing receive queue between the OBC serial
+ * port and the XMLReader.
+ */
+
+#include "XMLRxQueue.h"
+
+static const char tc_tag[] = "<TC>";
+static const char length_tag[] = "<Length>";
+static const char crc_close[] = "</CRC>";
+
+// advance a match of tag by one char, restarting on a new '<'
+static inline uint8_t matchTag(const char * tag, uint8_t tag_length, uint8_t matched, uint8_t data)
+{
+    if (matched < tag_length && tag[matched] == data) return matched + 1;
+
+    return ('<' == data) ? 1 : 0;
+}
+
+// --------------------------------------------------------
+// Producer side
+// --------------------------------------------------------
+
+void XMLRxQueue::push(uint8_t data)
+{
+    switch (frame_state) {
+    case RX_IDLE:
+        // anything between messages (e.g. the newline after a CRC) is skipped
+        if ('<' != data) return;
+
+        frame_dropping = false;
+        xml_length = 0;
+        tc_match = 0;
+        length_match = 0;
+        crc_match = 0;
+        in_length = false;
+        tc_length = 0;
+        frame_state = RX_XML;
+        store(data);
+        frameXML(data);
+        break;
+    case RX_XML:
+        store(data);
+        frameXML(data);
+        break;
+    case RX_BIN_WAIT:
+        // only the newline after the CRC node comes before "START"
+        if ('S' == data) {
+            store(data);
+            bin_remaining = BIN_FRAMING_SIZE - 1 + tc_length;
+            frame_state = RX_BIN;
+        } else if ('\n' == data) {
+            store(data);
+        } else {
+            drop();
+            push(data);
+        }
+        break;
+    case RX_BIN:
+    default:
+        store(data);
+        if (0 == --bin_remaining) commit();
+        break;
+    }
+}
+
+uint32_t XMLRxQueue::getDropped()
+{
+    return rx_dropped;
+}
+
+// follow the XML section to find its end, and the binary length for a TC
+void XMLRxQueue::frameXML(uint8_t data)
+{
+    // a section longer than any valid message is a framing error
+    if (++xml_length > MAX_XML_MSG_SIZE) {
+        drop();
+        return;
+    }
+
+    if (xml_length <= 4 && tc_match + 1 == xml_length) {
+        tc_match = (tc_tag[tc_match] == data) ? tc_match + 1 : 0;
+    }
+
+    if (in_length) {
+        if (data >= '0' && data <= '9') {
+            // the reader rejects a longer TC, and stopping here keeps the
+            // 16-bit length from overflowing. The rest of the XML is framed
+            // but discarded, and without the TC match its binary section is
+            // skipped as if between messages.
+            tc_length = tc_length * 10 + (data - '0');
+            if (tc_length > MAX_TC_SIZE) {
+                if (!frame_dropping) rx_dropped++;
+                frame_dropping = true;
+                rx_head = rx_commit;
+                in_length = false;
+                tc_match = 0;
+            }
+        } else {
+            in_length = false;
+        }
+    } else {
+        length_match = matchTag(length_tag, 8, length_match, data);
+        if (8 == length_match) {
+            in_length = true;
+            length_match = 0;
+        }
+    }
+
+    crc_match = matchTag(crc_close, 6, crc_match, data);
+    if (6 == crc_match) {
+        if (4 == tc_match) {
+            frame_state = RX_BIN_WAIT;
+        } else {
+            commit();
+        }
+    }
+}
+
+void XMLRxQueue::store(uint8_t data)
+{
+    if (frame_dropping) return;
+
+    // a message that doesn't fit is discarded as a whole
+    if ((uint16_t) (rx_head - rx_tail) >= RXQ_SIZE) {
+        frame_dropping = true;
+        rx_head = rx_commit;
+        rx_dropped++;
+        return;
+    }
+
+    ring[rx_head & RXQ_MASK] = data;
+    rx_head++;
+}
+
+// make the complete message visible to the reader
+void XMLRxQueue::commit()
+{
+    if (!frame_dropping) {
+        // the message bytes must be in the ring before the reader can see them
+        __sync_synchronize();
+        rx_commit = rx_head;
+    }
+
+    frame_state = RX_IDLE;
+}
+
+void XMLRxQueue::drop()
+{
+    if (!frame_dropping) rx_dropped++;
+
+    rx_head = rx_commit;
+    frame_state = RX_IDLE;
+}
+
+// --------------------------------------------------------
+// Consumer side
+// --------------------------------------------------------
+
+int XMLRxQueue::available()
+{
+    return (uint16_t) (rx_commit - rx_tail);
+}
+
+int XMLRxQueue::read()
+{
+    uint16_t tail = rx_tail;
+    uint8_t data;
+
+    if (tail == rx_commit) return -1;
+
+    __sync_synchronize();
+    data = ring[tail & RXQ_MASK];
+
+    // the byte must be read before the producer can reuse its slot
+    __sync_synchronize();
+    rx_tail = tail + 1;
+
+    return data;
+}
+
+int XMLRxQueue::peek()
+{
+    uint16_t tail = rx_tail;
+
+    if (tail == rx_commit) return -1;
+
+    __sync_synchronize();
+    return ring[tail & RXQ_MASK];
+}
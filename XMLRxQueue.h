@@ -0,0 +1,108 @@
+/*
+ * XMLRxQueue.h
+ * Created: October 2026
+ *
+ * This file declares a receive queue that is fed the OBC byte stream from an
+ * interrupt or serialEvent, so bytes leave the core's serial buffer as soon
+ * as they arrive rather than when the XMLReader next runs.
+ *
+ * The producer side frames the stream as it arrives: a message is only made
+ * visible to the reader once it is complete (through the CRC node, and the
+ * binary section for a TC), so the reader never waits on a partial message.
+ * The queue is a single-producer, single-consumer ring: push/poll from one
+ * context, and read from the main loop through the reader:
+ *
+ *     XMLRxQueue rx_queue;
+ *     XMLReaderT<XMLRxQueue> zephyrRX(&rx_queue, LPC);
+ *     void serialEvent1() { rx_queue.poll(Serial1); }
+ */
+
+#ifndef XMLRXQUEUE_H
+#define XMLRXQUEUE_H
+
+#include "XMLReader_v5.h"
+#include "Arduino.h"
+#include <stdint.h>
+
+// Ring size in bytes, must be a power of two, at most 32768, and hold the
+// largest TC message
+#ifndef RXQ_SIZE
+#define RXQ_SIZE 4096
+#endif
+
+#define RXQ_MASK (RXQ_SIZE - 1)
+
+// Largest message held: full XML, the newline before the binary section, and the largest TC
+#define RXQ_MAX_MESSAGE (MAX_XML_MSG_SIZE + 1 + BIN_FRAMING_SIZE + MAX_TC_SIZE)
+
+static_assert((RXQ_SIZE & RXQ_MASK) == 0, "RXQ_SIZE must be a power of two");
+static_assert(RXQ_SIZE >= RXQ_MAX_MESSAGE, "RXQ_SIZE must hold the largest TC message");
+static_assert(RXQ_SIZE <= 32768, "RXQ_SIZE must fit the 16-bit head and tail arithmetic");
+
+enum RxFrameState_t {
+    RX_IDLE,     // waiting for a message's opening '<'
+    RX_XML,      // in the XML section, until the CRC node closes
+    RX_BIN_WAIT, // TC only, waiting for the "START" of the binary section
+    RX_BIN       // TC only, in the binary section
+};
+
+class XMLRxQueue : public Stream {
+public:
+    XMLRxQueue() { };
+
+    // Producer side: call from one context only (ISR, serialEvent or loop)
+    void push(uint8_t data);
+
+    // push everything the port has received
+    template <class PortT>
+    uint16_t poll(PortT & port)
+    {
+        uint16_t num_bytes = 0;
+
+        while (port.available() > 0) {
+            push((uint8_t) port.read());
+            num_bytes++;
+        }
+
+        return num_bytes;
+    }
+
+    uint32_t getDropped(); // messages lost to a full queue or bad framing
+
+    // Consumer side: complete messages only, read by an XMLReader
+    int available();
+    int read();
+    int peek();
+    void flush() { };
+
+    // read-only
+    size_t write(uint8_t) { return 0; }
+
+private:
+    void store(uint8_t data);
+    void commit();
+    void drop();
+    void frameXML(uint8_t data);
+
+    uint8_t ring[RXQ_SIZE];
+
+    // the producer owns rx_head and rx_commit, the consumer owns rx_tail
+    uint16_t rx_head = 0; // next byte to write, uncommitted
+    volatile uint16_t rx_commit = 0; // end of the last complete message
+    volatile uint16_t rx_tail = 0; // next byte to read
+
+    // framing state
+    RxFrameState_t frame_state = RX_IDLE;
+    bool frame_dropping = false; // the current message didn't fit, discard it
+    uint16_t xml_length = 0;
+    uint8_t tc_match = 0;     // chars of "<TC>" matched at the start of the message
+    uint8_t length_match = 0; // chars of "<Length>" matched
+    uint8_t crc_match = 0;    // chars of "</CRC>" matched
+    bool in_length = false;
+    uint16_t tc_length = 0;
+    uint16_t bin_remaining = 0;
+
+    uint32_t rx_dropped = 0;
+};
+
+#endif /* XMLRXQUEUE_H */
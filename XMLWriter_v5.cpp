@@ -26,7 +26,144 @@
 
 #include <XMLWriter_v5.h>
 
-const uint16_t reset_crc = 0x1021;
+constexpr uint16_t reset_crc = 0x1021;
+
+// CRC-CCITT16 lookup table, indexed by (crc >> 8) ^ data
+static const uint16_t crc_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+// bitwise CRC-CCITT16 for compile-time use, matches crcBlock
+static constexpr uint16_t crcBits(uint16_t crc, uint8_t bits)
+{
+    return 0 == bits ? crc : crcBits((crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1), bits - 1);
+}
+
+static constexpr uint16_t crcString(uint16_t crc, const char * text)
+{
+    return '\0' == *text ? crc : crcString(crcBits(crc ^ ((uint8_t) *text << 8), 8), text + 1);
+}
+
+// advance a crc over length zero bytes
+static uint16_t crcZeros(uint16_t crc, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++) {
+        crc = (crc << 8) ^ crc_table[crc >> 8];
+    }
+
+    return crc;
+}
+
+// message openings up to the Msg value, with their CRC from reset_crc
+struct MsgPrefix_t {
+    const char * text;
+    uint8_t length;
+    uint16_t crc;
+};
+
+#define MSG_PREFIX(tag) {"<" tag ">\n\t<Msg>", sizeof("<" tag ">\n\t<Msg>") - 1, crcString(reset_crc, "<" tag ">\n\t<Msg>")}
+
+// indexed by MsgTemplateId_t
+static constexpr MsgPrefix_t msg_prefixes[NUM_MSG_TEMPLATES] = {
+    MSG_PREFIX("IMR"),
+    MSG_PREFIX("S"),
+    MSG_PREFIX("RA"),
+    MSG_PREFIX("IMAck"),
+    MSG_PREFIX("IMAck"),
+    MSG_PREFIX("TCAck"),
+    MSG_PREFIX("TCAck"),
+};
+
+// writes the decimal digits of value and a null terminator, returns the number of digits
+static uint8_t uintToChars(uint16_t value, char * out)
+{
+    char reversed[5];
+    uint8_t num_digits = 0;
+
+    do {
+        reversed[num_digits++] = '0' + (value % 10);
+        value /= 10;
+    } while (0 != value);
+
+    for (uint8_t i = 0; i < num_digits; i++) {
+        out[i] = reversed[num_digits - 1 - i];
+    }
+    out[num_digits] = '\0';
+
+    return num_digits;
+}
+
+// copies a null-terminated string into a fixed-size field, truncating if necessary
+static void copyField(char * field, const char * value, uint8_t field_size)
+{
+    if (NULL == value) value = "";
+
+    strncpy(field, value, field_size - 1);
+    field[field_size - 1] = '\0';
+}
+
+// big-endian stores, written with shifts so the compiler can vectorize array loops
+static inline void putWord(uint8_t * out, uint16_t word)
+{
+    out[0] = word >> 8;
+    out[1] = word & 0xFF;
+}
+
+static inline void putLong(uint8_t * out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = (value >> 16) & 0xFF;
+    out[2] = (value >> 8) & 0xFF;
+    out[3] = value & 0xFF;
+}
+
+static inline uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    return bits;
+}
+
+// update a crc over a block of bytes using the lookup table
+static inline uint16_t crcBlock(uint16_t crc, const uint8_t * data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++) {
+        crc = (crc << 8) ^ crc_table[(uint8_t) ((crc >> 8) ^ data[i])];
+    }
+
+    return crc;
+}
 
 // Constant Device Information
 char swDate[] = "20170901,000000";
@@ -37,41 +174,200 @@ char Zproto[] = "1.0";
 // Constructor and reset
 // --------------------------------------------------------
 
-#ifdef LOG
-XMLWriter::XMLWriter(Print* stream, Print* log, Instrument_t inst)
-{
-    _log = log;
-    _log->println("Written messages with be logged.");
-#else
 XMLWriter::XMLWriter(Print* stream, Instrument_t inst)
 {
-#endif
     instrument = inst;
     _stream = stream;
     reset();
+    buildTemplates();
 }
 
 void XMLWriter::reset()
 {
     tx_crc = reset_crc;
-    clearTm();
+
+    for (uint8_t i = 0; i < TM_NUM_BUFFERS; i++) {
+        tm_frames[i].state = TM_ACKED;
+        tm_frames[i].send_seq = 0;
+        tm_frames[i].spool_seq = 0;
+    }
+    tm_sent_count = 0;
+    tm_acked_count = 0;
+    for (uint8_t i = 0; i < TMQ_SIZE; i++) {
+        tm_queue[i].frame = NULL;
+        tm_queue[i].used = false;
+    }
+    tm_frame = &tm_frames[0];
+    nextTmFrame();
+#ifdef WRITER_STATS
+    resetStats();
+#endif
+}
+
+#ifdef WRITER_STATS
+// --------------------------------------------------------
+// Writer statistics
+// --------------------------------------------------------
+
+const WriterStats_t & XMLWriter::getStats()
+{
+    return stats;
+}
+
+void XMLWriter::resetStats()
+{
+    memset(&stats, 0, sizeof(stats));
+    stat_msg_us = 0;
+}
+
+void XMLWriter::statBegin(WriterMsg_t msg)
+{
+    // an asynchronous TM still going out is finished before the next message
+    finishTM();
+
+    stat_msg = msg;
+    stat_msg_us = 0;
+    stats.msg[msg].messages++;
+}
+
+void XMLWriter::statWrite(WriterMsg_t msg, bool binary, uint16_t bytes, uint32_t start_us)
+{
+    WriterMsgStats_t * counters = &stats.msg[msg];
+    uint32_t elapsed = micros() - start_us;
+
+    if (binary) {
+        counters->bin_bytes += bytes;
+    } else {
+        counters->xml_bytes += bytes;
+    }
+
+    counters->write_us += elapsed;
+    stat_msg_us += elapsed;
+    if (stat_msg_us > counters->max_write_us) counters->max_write_us = stat_msg_us;
+}
+#endif
+
+// --------------------------------------------------------
+// Log transcript
+// --------------------------------------------------------
+
+void XMLWriter::setLog(Print* log)
+{
+    _log = log;
+    log_tail = 0;
+    log_count = 0;
+}
+
+uint16_t XMLWriter::drainLog()
+{
+    int space;
+
+    if (NULL == _log || 0 == log_count) return 0;
+
+    space = _log->availableForWrite();
+    if (space <= 0) return 0;
+
+    return writeLog((uint16_t) space);
+}
+
+void XMLWriter::flushLog()
+{
+    if (NULL == _log) return;
+
+    while (0 != log_count) {
+        writeLog(LOG_RING_SIZE);
+    }
+}
+
+uint32_t XMLWriter::getLogDropped()
+{
+    return log_dropped;
+}
+
+// log bytes written to the stream: straight through while the sink has room
+// and nothing's buffered, otherwise through the ring. Only bytes that fit in
+// neither are dropped, so writes larger than the ring are logged in pieces.
+void XMLWriter::logBytes(const uint8_t * data, uint16_t length)
+{
+    uint16_t head, first, chunk;
+    int space;
+
+    if (NULL == _log || 0 == length) return;
+
+    while (0 != length) {
+        // buffered bytes go out first, to keep the transcript in order
+        drainLog();
+
+        if (0 == log_count) {
+            space = _log->availableForWrite();
+            if (space > 0) {
+                chunk = (length < space) ? length : (uint16_t) space;
+                _log->write(data, chunk);
+                data += chunk;
+                length -= chunk;
+                continue;
+            }
+        }
+
+        // buffer what fits, stopping once the ring is full and the sink is too
+        chunk = LOG_RING_SIZE - log_count;
+        if (chunk > length) chunk = length;
+        if (0 == chunk) break;
+
+        head = (log_tail + log_count) % LOG_RING_SIZE;
+        first = LOG_RING_SIZE - head;
+        if (first > chunk) first = chunk;
+
+        memcpy(log_ring + head, data, first);
+        memcpy(log_ring, data + first, chunk - first);
+        log_count += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+
+    log_dropped += length;
+}
+
+// write up to max_bytes from the ring, in at most two contiguous chunks
+uint16_t XMLWriter::writeLog(uint16_t max_bytes)
+{
+    uint16_t written = 0;
+    uint16_t chunk;
+
+    while (0 != log_count && written < max_bytes) {
+        chunk = LOG_RING_SIZE - log_tail;
+        if (chunk > log_count) chunk = log_count;
+        if (chunk > max_bytes - written) chunk = max_bytes - written;
+
+        _log->write(log_ring + log_tail, chunk);
+        log_tail = (log_tail + chunk) % LOG_RING_SIZE;
+        log_count -= chunk;
+        written += chunk;
+    }
+
+    return written;
 }
 
 // --------------------------------------------------------
 // Telemetry state fields functions
 // --------------------------------------------------------
 
-void XMLWriter::setStateFlags(uint8_t num, String flag)
+void XMLWriter::setStateFlags(uint8_t num, const char * flag)
 {
     if (num == 1) {
-        StateFlag1 = flag;
+        copyField(StateFlag1, flag, STATE_FLAG_SIZE);
     } else if (num == 2) {
-        StateFlag2 = flag;
+        copyField(StateFlag2, flag, STATE_FLAG_SIZE);
     } else if (num == 3) {
-        StateFlag3 = flag;
+        copyField(StateFlag3, flag, STATE_FLAG_SIZE);
     }
 }
 
+void XMLWriter::setStateFlags(uint8_t num, const String & flag)
+{
+    setStateFlags(num, flag.c_str());
+}
+
 void XMLWriter::setStateFlagValue(uint8_t num, StateFlag_t stat)
 {
     if (num == 1) {
@@ -83,36 +379,44 @@ void XMLWriter::setStateFlagValue(uint8_t num, StateFlag_t stat)
     }
 }
 
-void XMLWriter::setStateDetails(uint8_t num, String details)
+void XMLWriter::setStateDetails(uint8_t num, const char * details)
 {
     if (num == 1) {
-        details1 = details;
+        copyField(details1, details, STATE_DETAILS_SIZE);
     } else if (num == 2) {
-        details2 = details;
+        copyField(details2, details, STATE_DETAILS_SIZE);
     } else if (num == 3) {
-        details3 = details;
+        copyField(details3, details, STATE_DETAILS_SIZE);
     }
 }
 
+void XMLWriter::setStateDetails(uint8_t num, const String & details)
+{
+    setStateDetails(num, details.c_str());
+}
+
 // --------------------------------------------------------
 // Tag functions
 // --------------------------------------------------------
 
 void XMLWriter::tagOpen(const char* tag)
 {
-    writeAndUpdateCRC('<');
-    writeAndUpdateCRC(tag);
-    writeAndUpdateCRC('>');
-    writeAndUpdateCRC('\n');
+    // a new message can't start until a queued TM is fully written
+    finishTM();
+
+    bufferXML('<');
+    bufferXML(tag);
+    bufferXML('>');
+    bufferXML('\n');
 }
 
 void XMLWriter::tagClose(const char* tag)
 {
-    writeAndUpdateCRC('<');
-    writeAndUpdateCRC('/');
-    writeAndUpdateCRC(tag);
-    writeAndUpdateCRC('>');
-    writeAndUpdateCRC('\n');
+    bufferXML('<');
+    bufferXML('/');
+    bufferXML(tag);
+    bufferXML('>');
+    bufferXML('\n');
 }
 
 // --------------------------------------------------------
@@ -121,65 +425,58 @@ void XMLWriter::tagClose(const char* tag)
 
 void XMLWriter::writeNode(const char* tag, const char* value)
 {
-    writeAndUpdateCRC('\t');
-    writeAndUpdateCRC('<');
-    writeAndUpdateCRC(tag);
-    writeAndUpdateCRC('>');
-    writeAndUpdateCRC(value);
-    writeAndUpdateCRC('<');
-    writeAndUpdateCRC('/');
-    writeAndUpdateCRC(tag);
-    writeAndUpdateCRC('>');
-    writeAndUpdateCRC('\n');
-}
-
-void XMLWriter::writeNode(const char* tag, String value)
-{
-    writeNode(tag, value.c_str());
+    bufferXML('\t');
+    bufferXML('<');
+    bufferXML(tag);
+    bufferXML('>');
+    bufferXML(value);
+    bufferXML('<');
+    bufferXML('/');
+    bufferXML(tag);
+    bufferXML('>');
+    bufferXML('\n');
 }
 
 void XMLWriter::writeNode(const char* tag, char* value, uint8_t length)
 {
-    writeAndUpdateCRC('\t');
-    writeAndUpdateCRC('<');
-    writeAndUpdateCRC(tag);
-    writeAndUpdateCRC('>');
+    bufferXML('\t');
+    bufferXML('<');
+    bufferXML(tag);
+    bufferXML('>');
     for (uint8_t i = 0; i < length; i++) {
         if (value[i] != 0) {
-            writeAndUpdateCRC(value[i]);
+            bufferXML(value[i]);
         } else {
             break;
         }
     }
-    writeAndUpdateCRC('<');
-    writeAndUpdateCRC('/');
-    writeAndUpdateCRC(tag);
-    writeAndUpdateCRC('>');
-    writeAndUpdateCRC('\n');
+    bufferXML('<');
+    bufferXML('/');
+    bufferXML(tag);
+    bufferXML('>');
+    bufferXML('\n');
 }
 
 void XMLWriter::writeNode(const char* tag, uint8_t value)
 {
-    writeAndUpdateCRC('\t');
-    writeAndUpdateCRC('<');
-    writeAndUpdateCRC(tag);
-    writeAndUpdateCRC('>');
-    writeAndUpdateCRC(value);
-    writeAndUpdateCRC('<');
-    writeAndUpdateCRC('/');
-    writeAndUpdateCRC(tag);
-    writeAndUpdateCRC('>');
-    writeAndUpdateCRC('\n');
+    bufferXML('\t');
+    bufferXML('<');
+    bufferXML(tag);
+    bufferXML('>');
+    bufferXML(value);
+    bufferXML('<');
+    bufferXML('/');
+    bufferXML(tag);
+    bufferXML('>');
+    bufferXML('\n');
 }
 
-void XMLWriter::writeNode(String tag, String value)
+void XMLWriter::writeNode(const char* tag, uint16_t value)
 {
-    writeNode(tag.c_str(), value.c_str());
-}
+    char digits[6];
 
-void XMLWriter::writeNode(String tag, const char* value)
-{
-    writeNode(tag.c_str(), value);
+    uintToChars(value, digits);
+    writeNode(tag, (const char *) digits);
 }
 
 // --------------------------------------------------------
@@ -198,22 +495,43 @@ uint16_t XMLWriter::crcValue()
 
 void XMLWriter::writeCRC()
 {
-    _stream->print("<CRC>");
-    _stream->print(tx_crc, DEC);
-    _stream->print("</CRC>\n");
-#ifdef LOG
-    _log->print("<CRC>");
-    _log->print(tx_crc, DEC);
-    _log->print("</CRC>\n");
-#endif
+    bufferCRC();
+    flushXML();
     crcReset();
 }
 
+void XMLWriter::bufferCRC()
+{
+    // CRC the bytes still in the buffer, the CRC node itself isn't included
+    crcUpdate(xml_buffer, num_xml_elements);
+    bufferCRCNode();
+}
+
+void XMLWriter::bufferCRCNode()
+{
+    char crc_node[18] = "<CRC>";
+    uint8_t node_len = 5;
+
+    node_len += uintToChars(tx_crc, crc_node + node_len);
+    memcpy(crc_node + node_len, "</CRC>\n", 7);
+    node_len += 7;
+    if (num_xml_elements + node_len > XMLBUF_MAXSIZE) {
+        flushXML();
+    }
+    memcpy(xml_buffer + num_xml_elements, crc_node, node_len);
+    num_xml_elements += node_len;
+}
+
+void XMLWriter::crcUpdate(const uint8_t * data, uint16_t length)
+{
+    tx_crc = crcBlock(tx_crc, data, length);
+}
+
 // --------------------------------------------------------
-// Send over serial and update the CRC
+// Assemble the XML message and send it over serial
 // --------------------------------------------------------
 
-void XMLWriter::writeAndUpdateCRC(uint8_t* data, uint8_t length)
+void XMLWriter::bufferXML(uint8_t* data, uint8_t length)
 {
     if (length == 0 || data == NULL) {
         return;
@@ -225,12 +543,12 @@ void XMLWriter::writeAndUpdateCRC(uint8_t* data, uint8_t length)
         if ((x == 0) & (c != 0)) {
             break;
         }
-        writeAndUpdateCRC(x);
+        bufferXML(x);
     }
     return;
 }
 
-void XMLWriter::writeAndUpdateCRC(const char* data)
+void XMLWriter::bufferXML(const char* data)
 {
     uint16_t c;
     uint8_t x;
@@ -239,26 +557,36 @@ void XMLWriter::writeAndUpdateCRC(const char* data)
         if ((x == 0) & (c != 0)) {
             break;
         }
-        writeAndUpdateCRC(x);
+        bufferXML(x);
     }
     return;
 }
 
-inline void XMLWriter::writeAndUpdateCRC(uint8_t data)
+inline void XMLWriter::bufferXML(uint8_t data)
 {
-    uint8_t msb = tx_crc >> 8;
-    uint8_t lsb = tx_crc & 255;
-    uint16_t c;
-    _stream->write(data);
-#ifdef LOG
-    _log->write(data);
+    // an oversized message is CRC'd and sent in pieces
+    if (XMLBUF_MAXSIZE == num_xml_elements) {
+        crcUpdate(xml_buffer, num_xml_elements);
+        flushXML();
+    }
+
+    xml_buffer[num_xml_elements++] = data;
+}
+
+void XMLWriter::flushXML()
+{
+    if (0 == num_xml_elements) return;
+
+#ifdef WRITER_STATS
+    uint32_t start_us = micros();
 #endif
-    c = data ^ msb;
-    c ^= (c >> 4);
-    msb = (lsb ^ (c >> 3) ^ (c << 4)) & 255;
-    lsb = (c ^ (c << 5)) & 255;
-    tx_crc = (msb << 8) + lsb;
-    return;
+    _stream->write(xml_buffer, num_xml_elements);
+#ifdef WRITER_STATS
+    statWrite(stat_msg, false, num_xml_elements, start_us);
+#endif
+    logBytes(xml_buffer, num_xml_elements);
+    bytes_written += num_xml_elements;
+    num_xml_elements = 0;
 }
 
 // --------------------------------------------------------
@@ -267,13 +595,19 @@ inline void XMLWriter::writeAndUpdateCRC(uint8_t data)
 
 uint16_t XMLWriter::msgNode()
 {
-    String buf = String(messCount);
-    writeNode("Msg", buf.c_str());
+    writeNode("Msg", nextMsgCount());
+    return messCount;
+}
+
+uint16_t XMLWriter::nextMsgCount()
+{
+    uint16_t count = messCount;
+
     messCount++;
     if (messCount == 65534) {
         messCount = 1;
     }
-    return messCount;
+    return count;
 }
 
 void XMLWriter::instNode()
@@ -287,68 +621,139 @@ void XMLWriter::instNode()
 
 void XMLWriter::IMR()
 {
-    tagOpen("IMR");
-    msgNode();
-    instNode();
-    writeNode("SWDate", swDate);
-    writeNode("SWVersion", swVer);
-    writeNode("ZProtocolVersion", Zproto);
-    tagClose("IMR");
-    writeCRC();
+#ifdef WRITER_STATS
+    statBegin(STAT_IMR);
+#endif
+    sendTemplate(TMPL_IMR);
 }
 
 void XMLWriter::S()
 {
-    tagOpen("S");
-    msgNode();
-    instNode();
-    tagClose("S");
-    writeCRC();
+#ifdef WRITER_STATS
+    statBegin(STAT_S);
+#endif
+    sendTemplate(TMPL_S);
 }
 
 void XMLWriter::RA()
 {
     if (RACHUTS != instrument) { //Writer does not have inst enum
-#ifdef LOG
-        _log->print("Invalid devId: ");
-        _log->println(inst_ids[instrument]);
-#endif
         return;
     }
-    tagOpen("RA");
-    msgNode();
-    writeNode("Inst", "RACHUTS");
-    tagClose("RA");
-    writeCRC();
+#ifdef WRITER_STATS
+    statBegin(STAT_RA);
+#endif
+    sendTemplate(TMPL_RA);
 }
 
 void XMLWriter::IMAck(bool ackval)
 {
-    tagOpen("IMAck");
-    msgNode();
-    instNode();
-    if (ackval) {
-        writeNode("Ack", "ACK");
-    } else {
-        writeNode("Ack", "NACK");
+#ifdef WRITER_STATS
+    statBegin(STAT_IMACK);
+#endif
+    sendTemplate(ackval ? TMPL_IMACK : TMPL_IMNAK);
+}
+
+void XMLWriter::TCAck(bool ackval)
+{
+#ifdef WRITER_STATS
+    statBegin(STAT_TCACK);
+#endif
+    sendTemplate(ackval ? TMPL_TCACK : TMPL_TCNAK);
+}
+
+void XMLWriter::sendTemplate(MsgTemplateId_t id)
+{
+    const MsgTemplate_t * tmpl = &templates[id];
+    char digits[6];
+    uint8_t num_digits;
+    uint16_t crc;
+
+    // a new message can't start until a queued TM is fully written
+    finishTM();
+
+    num_digits = uintToChars(nextMsgCount(), digits);
+
+    memcpy(xml_buffer, tmpl->prefix, tmpl->prefix_len);
+    num_xml_elements = tmpl->prefix_len;
+    memcpy(xml_buffer + num_xml_elements, digits, num_digits);
+    num_xml_elements += num_digits;
+    memcpy(xml_buffer + num_xml_elements, tmpl->suffix, tmpl->suffix_len);
+    num_xml_elements += tmpl->suffix_len;
+
+    // only the Msg value is CRC'd, the suffix is applied through its shift table
+    crc = crcBlock(tmpl->prefix_crc, (const uint8_t *) digits, num_digits);
+    tx_crc = tmpl->suffix_crc;
+    for (uint8_t i = 0; i < 16; i++) {
+        if (crc & (1 << i)) tx_crc ^= tmpl->suffix_shift[i];
     }
 
-    tagClose("IMAck");
-    writeCRC();
+    bufferCRCNode();
+    flushXML();
+    crcReset();
 }
 
-void XMLWriter::TCAck(bool ackval)
+// --------------------------------------------------------
+// Message templates
+// --------------------------------------------------------
+
+void XMLWriter::buildTemplates()
 {
-    tagOpen("TCAck");
-    msgNode();
-    instNode();
-    if (ackval) {
-        writeNode("Ack", "ACK");
-    } else {
-        writeNode("Ack", "NACK");
+    for (uint8_t i = 0; i < NUM_MSG_TEMPLATES; i++) {
+        templates[i].prefix = msg_prefixes[i].text;
+        templates[i].prefix_len = msg_prefixes[i].length;
+        templates[i].prefix_crc = msg_prefixes[i].crc;
+        buildSuffix((MsgTemplateId_t) i);
+    }
+}
+
+// render the suffix with the usual node functions, then record its effect on the CRC
+void XMLWriter::buildSuffix(MsgTemplateId_t id)
+{
+    MsgTemplate_t * tmpl = &templates[id];
+
+    num_xml_elements = 0;
+    tagClose("Msg");
+
+    switch (id) {
+    case TMPL_IMR:
+        instNode();
+        writeNode("SWDate", swDate);
+        writeNode("SWVersion", swVer);
+        writeNode("ZProtocolVersion", Zproto);
+        tagClose("IMR");
+        break;
+    case TMPL_S:
+        instNode();
+        tagClose("S");
+        break;
+    case TMPL_RA:
+        writeNode("Inst", "RACHUTS");
+        tagClose("RA");
+        break;
+    case TMPL_IMACK:
+    case TMPL_IMNAK:
+        instNode();
+        writeNode("Ack", TMPL_IMACK == id ? "ACK" : "NACK");
+        tagClose("IMAck");
+        break;
+    case TMPL_TCACK:
+    case TMPL_TCNAK:
+    default:
+        instNode();
+        writeNode("Ack", TMPL_TCACK == id ? "ACK" : "NACK");
+        tagClose("TCAck");
+        break;
+    }
+
+    memcpy(tmpl->suffix, xml_buffer, num_xml_elements);
+    tmpl->suffix_len = num_xml_elements;
+    num_xml_elements = 0;
+
+    tmpl->suffix_crc = crcBlock(0, tmpl->suffix, tmpl->suffix_len);
+    for (uint8_t i = 0; i < 16; i++) {
+        tmpl->suffix_shift[i] = crcZeros(1 << i, tmpl->suffix_len);
     }
-    tagClose("TCAck");
-    writeCRC();
 }
 
 // --------------------------------------------------------
@@ -357,128 +762,340 @@ void XMLWriter::TCAck(bool ackval)
 
 void XMLWriter::TM()
 {
-    tagOpen("TM");
-    msgNode();
-    instNode();
-    sendTMBody();
-    String buf = String(num_tm_elements);
-    writeNode("Length", buf.c_str());
-    tagClose("TM");
-#ifdef LOG
-    _log->print("Number of items in telemetry buffer: ");
-    _log->println(num_tm_elements);
-#endif
-    writeCRC();
-    sendBin();
+    sendFrame(tm_frame);
 }
 
-void XMLWriter::TM_String(StateFlag_t state_flag, const char * message)
+bool XMLWriter::retransmitTm()
 {
-    tagOpen("TM");
-    msgNode();
-    instNode();
+    TMFrame_t * frame = NULL;
 
-    // write the state flag
-    if (state_flag == FINE) {
-        writeNode("StateFlag1", "FINE");
-    } else if (state_flag == WARN) {
-        writeNode("StateFlag1", "WARN");
-    } else if (state_flag == CRIT) {
-        writeNode("StateFlag1", "CRIT");
-    } else {
-        writeNode("StateFlag1", "UNKN");
+    // resend the oldest frame that was NAK'd
+    for (uint8_t i = 0; i < TM_NUM_BUFFERS; i++) {
+        if (TM_NAKED == tm_frames[i].state && (NULL == frame || tm_frames[i].send_seq < frame->send_seq)) {
+            frame = &tm_frames[i];
+        }
     }
 
-    // write the actual message of up to 100 chars
-    writeNode("StateMess1", message);
+    if (NULL == frame) return false;
 
-    writeNode("Length", "0"); // no binary
-    tagClose("TM");
-    writeCRC();
-    sendEmptyBin(); // expected, even if empty
+    sendFrame(frame);
+    return true;
 }
 
-void XMLWriter::sendBin()
+bool XMLWriter::retransmitTm(uint16_t msg_id)
 {
-    // Calling function does proper input check
-    crcReset();
-    _stream->print("START");
-#ifdef LOG
-    _log->print("START");
-#endif
-
-    for (uint16_t i = 0; i < num_tm_elements; i++) {
-        writeAndUpdateCRC(tm_buffer[i]);
+    for (uint8_t i = 0; i < TM_NUM_BUFFERS; i++) {
+        if (TM_FILLING != tm_frames[i].state && TM_ACKED != tm_frames[i].state && msg_id == tm_frames[i].msg_id) {
+            sendFrame(&tm_frames[i]);
+            return true;
+        }
     }
 
-    uint16_t binCrc = tx_crc;
-    uint8_t send;
-    crcReset();
+    return false;
+}
 
-    send = binCrc >> 8;
-    _stream->write((byte)send);
-    send = (binCrc & (0x00FF));
-    _stream->write((byte)send);
+uint16_t XMLWriter::tmAck(bool ackval)
+{
+    TMFrame_t * frame;
+    TMSent_t * sent;
 
-    _stream->print("END");
-#ifdef LOG
-    _log->println();
-    _log->println(binCrc, HEX);
-    _log->println("END");
-#endif
+    // the OBC acknowledges every TM, string or frame, in the order they're sent
+    if (tm_acked_count == tm_sent_count) return 0;
+    sent = &tm_sent[tm_acked_count % TM_SENT_RING_SIZE];
 
-    tm_buff_sent = true;
+    // sent so long ago it's been overwritten
+    if (tm_sent_count - tm_acked_count++ > TM_SENT_RING_SIZE) return 0;
 
-    return;
+    // only a frame still retained as sent takes the result, not a string,
+    // nor a frame since resent or reclaimed
+    frame = sent->frame;
+    if (NULL == frame || TM_UNACKED != frame->state || sent->send_seq != frame->send_seq) {
+        return sent->msg_id;
+    }
+
+    // a NAK'd frame is retained until it's retransmitted or reclaimed
+    frame->state = ackval ? TM_ACKED : TM_NAKED;
+
+    if (ackval && 0 != frame->spool_seq) {
+        if (NULL != tm_spool) tm_spool->ack(frame->spool_seq);
+        frame->spool_seq = 0;
+    }
+
+    return frame->msg_id;
 }
 
-void XMLWriter::sendEmptyBin()
+void XMLWriter::recordSent(TMFrame_t * frame, uint16_t msg_id)
 {
-    uint16_t binCrc = tx_crc;
-    uint8_t send;
+    TMSent_t * sent = &tm_sent[tm_sent_count++ % TM_SENT_RING_SIZE];
 
-    // Calling function does proper input check
-    crcReset();
-    _stream->print("START");
-#ifdef LOG
-    _log->print("START");
-#endif
+    sent->frame = frame;
+    sent->send_seq = (NULL == frame) ? 0 : frame->send_seq;
+    sent->msg_id = msg_id;
+}
 
-    send = binCrc >> 8;
-    _stream->write(send);
-    send = (binCrc & (0x00FF));
-    _stream->write(send);
-
-    //end
-    _stream->print("END");
-#ifdef LOG
-    _log->println();
-    _log->println(binCrc, HEX);
-    _log->println("END");
-#endif
+uint16_t XMLWriter::getTmDropped()
+{
+    return tm_dropped;
 }
 
-void XMLWriter::sendTMBody()
+void XMLWriter::setSpool(TMSpool * spool)
 {
-    switch (flag1) {
-    case (FINE):
-        writeNode(StateFlag1, "FINE");
-        break;
-    case (CRIT):
-        writeNode(StateFlag1, "CRIT");
-        break;
-    case (WARN):
-        writeNode(StateFlag1, "WARN");
-        break;
-    case (UNKN):
-        writeNode(StateFlag1, "UNKN");
-        break;
-    default:
-        writeNode("StateMess1", "UNKN");
-    }
-    if (details1.length() != 0) {
-        writeNode("StateMess1", details1);
-    }
+    tm_spool = spool;
+}
+
+bool XMLWriter::spoolTm()
+{
+    if (NULL == tm_spool || TM_FILLING != tm_frame->state) return false;
+
+    flushTmBits();
+    if (0 == tm_frame->length || 0 == tm_spool->append(tm_frame->data, tm_frame->length)) return false;
+
+    clearTm();
+    return true;
+}
+
+bool XMLWriter::drainSpool()
+{
+    TMFrame_t * frame = NULL;
+    uint32_t seq;
+    uint16_t length;
+
+    if (NULL == tm_spool || !tm_spool->pending()) return false;
+
+    // a free frame, or the one being filled if nothing's been added to it
+    for (uint8_t i = 0; i < TM_NUM_BUFFERS; i++) {
+        if (TM_ACKED == tm_frames[i].state && tm_frame != &tm_frames[i]) {
+            frame = &tm_frames[i];
+            break;
+        }
+    }
+
+    if (NULL == frame && TM_FILLING == tm_frame->state && 0 == tm_frame->length && 0 == tm_bit_count) {
+        frame = tm_frame;
+    }
+
+    if (NULL == frame) return false;
+
+    // a record spooled before compression was enabled can be longer than
+    // tm_capacity, it's sent unflagged as sendFrame would have
+    length = tm_spool->next(frame->data, TMBUF_MAXSIZE, &seq);
+    if (0 == length) return false;
+
+    frame->length = length;
+    frame->crc = crcBlock(reset_crc, frame->data, length);
+    frame->spool_seq = seq;
+    sendFrame(frame);
+    return true;
+}
+
+// a spooled record stays in the spool until it's acked, otherwise the
+// frame's data is appended; false if the data is lost
+bool XMLWriter::spoolFrame(TMFrame_t * frame)
+{
+    if (NULL == tm_spool) return false;
+
+    if (0 != frame->spool_seq) {
+        tm_spool->release(frame->spool_seq);
+        return true;
+    }
+
+    // an empty frame has nothing to keep
+    return 0 == frame->length || 0 != tm_spool->append(frame->data, frame->length);
+}
+
+void XMLWriter::sendFrame(TMFrame_t * frame)
+{
+    const uint8_t * payload = frame->data;
+    uint16_t payload_len = frame->length;
+    uint16_t payload_crc;
+
+    // an asynchronous TM still going out points into tm_start and tm_packed,
+    // so it's finished before they're reused
+    finishTM();
+
+    // any pending bits go out with the frame being filled
+    if (frame == tm_frame) {
+        flushTmBits();
+        payload_len = frame->length;
+    }
+    payload_crc = frame->crc;
+
+#ifdef WRITER_STATS
+    statBegin(STAT_TM);
+#endif
+
+    // the binary section starts with "START" and, when compressing, a payload header
+    tm_start_len = 5;
+    if (tm_compression) {
+        packFrame(frame, &payload, &payload_len, &payload_crc);
+    }
+
+    tagOpen("TM");
+    frame->msg_id = messCount;
+    msgNode();
+    instNode();
+    sendTMBody();
+    writeNode("Length", (uint16_t) (tm_start_len - 5 + payload_len));
+    tagClose("TM");
+    if (async_tm) {
+        // the XML stays in the buffer, queued ahead of the binary section
+        bufferCRC();
+        crcReset();
+    } else {
+        writeCRC();
+    }
+    sendBin(frame, payload, payload_len, payload_crc);
+}
+
+// compress the frame into tm_packed if that makes it smaller, and set the payload header
+void XMLWriter::packFrame(TMFrame_t * frame, const uint8_t ** payload, uint16_t * length, uint16_t * bin_crc)
+{
+    uint16_t packed_len = 0;
+
+    // only worth sending compressed if smaller than the raw payload and its header
+    if (frame->length > TMC_LZF_HEADER_SIZE) {
+        packed_len = TMCompress(frame->data, frame->length, tm_packed,
+                                frame->length + TMC_RAW_HEADER_SIZE - TMC_LZF_HEADER_SIZE - 1, &tm_comp_state);
+    }
+
+    if (0 != packed_len) {
+        tm_start[5] = TMC_LZF;
+        tm_start[6] = frame->length >> 8;
+        tm_start[7] = frame->length & 0xFF;
+        tm_start_len = 5 + TMC_LZF_HEADER_SIZE;
+        *payload = tm_packed;
+        *length = packed_len;
+    } else if (frame->length + TMC_RAW_HEADER_SIZE <= TMBUF_MAXSIZE) {
+        tm_start[5] = TMC_RAW;
+        tm_start_len = 5 + TMC_RAW_HEADER_SIZE;
+    } else {
+        // compression was enabled after the frame was filled to the limit,
+        // there's no room for a header so it goes unflagged
+        return;
+    }
+
+    // the header is part of the CRC'd binary section
+    *bin_crc = crcBlock(crcBlock(reset_crc, tm_start + 5, tm_start_len - 5), *payload, *length);
+}
+
+void XMLWriter::setTmCompression(bool enable)
+{
+    tm_compression = enable;
+
+    // leave room in each frame for the raw payload header
+    tm_capacity = enable ? TMBUF_MAXSIZE - TMC_RAW_HEADER_SIZE : TMBUF_MAXSIZE;
+}
+
+void XMLWriter::TM_String(StateFlag_t state_flag, const char * message)
+{
+#ifdef WRITER_STATS
+    statBegin(STAT_TM_STRING);
+#endif
+    tagOpen("TM");
+    recordSent(NULL, messCount); // acknowledged like any other TM
+    msgNode();
+    instNode();
+
+    // write the state flag
+    if (state_flag == FINE) {
+        writeNode("StateFlag1", "FINE");
+    } else if (state_flag == WARN) {
+        writeNode("StateFlag1", "WARN");
+    } else if (state_flag == CRIT) {
+        writeNode("StateFlag1", "CRIT");
+    } else {
+        writeNode("StateFlag1", "UNKN");
+    }
+
+    // write the actual message of up to 100 chars
+    writeNode("StateMess1", message);
+
+    writeNode("Length", "0"); // no binary
+    tagClose("TM");
+    writeCRC();
+    sendEmptyBin(); // expected, even if empty
+}
+
+void XMLWriter::sendBin(TMFrame_t * frame, const uint8_t * payload, uint16_t length, uint16_t binCrc)
+{
+    // Calling function does proper input check
+    crcReset();
+
+    // the CRC and "END" trail the buffer
+    tm_trailer[0] = binCrc >> 8;
+    tm_trailer[1] = (binCrc & (0x00FF));
+    memcpy(tm_trailer + 2, "END", 3);
+
+    // queue the message: any XML still buffered, then the binary section
+    tx_segments[0] = xml_buffer;
+    tx_lengths[0] = num_xml_elements;
+    tx_segments[1] = tm_start;
+    tx_lengths[1] = tm_start_len;
+    tx_segments[2] = payload;
+    tx_lengths[2] = length;
+    tx_segments[3] = tm_trailer;
+    tx_lengths[3] = 5;
+
+    tx_segment = 0;
+    tx_index = 0;
+    tx_sent = 0;
+    tx_total = num_xml_elements + tm_start_len + length + 5;
+    tx_frame = frame;
+
+    // retained until acknowledged, producers move on to another frame
+    frame->state = TM_UNACKED;
+    frame->send_seq = ++tm_send_seq;
+    recordSent(frame, frame->msg_id);
+
+    if (!async_tm) {
+        finishTM();
+    }
+
+    return;
+}
+
+void XMLWriter::sendEmptyBin()
+{
+    uint16_t binCrc = tx_crc;
+    uint8_t bin_section[10] = {'S', 'T', 'A', 'R', 'T', 0, 0, 'E', 'N', 'D'};
+
+    // Calling function does proper input check
+    crcReset();
+
+    bin_section[5] = binCrc >> 8;
+    bin_section[6] = (binCrc & (0x00FF));
+#ifdef WRITER_STATS
+    uint32_t start_us = micros();
+#endif
+    _stream->write(bin_section, 10);
+#ifdef WRITER_STATS
+    statWrite(STAT_TM_STRING, true, 10, start_us);
+#endif
+    bytes_written += 10;
+    logBytes(bin_section, 10);
+}
+
+void XMLWriter::sendTMBody()
+{
+    switch (flag1) {
+    case (FINE):
+        writeNode(StateFlag1, "FINE");
+        break;
+    case (CRIT):
+        writeNode(StateFlag1, "CRIT");
+        break;
+    case (WARN):
+        writeNode(StateFlag1, "WARN");
+        break;
+    case (UNKN):
+        writeNode(StateFlag1, "UNKN");
+        break;
+    default:
+        writeNode("StateMess1", "UNKN");
+    }
+    if (details1[0] != '\0') {
+        writeNode("StateMess1", details1);
+    }
 
     switch (flag2) {
     case (FINE):
@@ -498,7 +1115,7 @@ void XMLWriter::sendTMBody()
     default:
         writeNode(StateFlag2, "UNKN");
     }
-    if (details2.length() != 0) {
+    if (details2[0] != '\0') {
         writeNode("StateMess2", details2);
     }
 
@@ -520,11 +1137,383 @@ void XMLWriter::sendTMBody()
     default:
         writeNode(StateFlag3, "UNKN");
     }
-    if (details3.length() != 0) {
+    if (details3[0] != '\0') {
         writeNode("StateMess3", details3);
     }
 }
 
+// --------------------------------------------------------
+// Priority queue and downlink budget
+// --------------------------------------------------------
+
+void XMLWriter::setDownlinkBudget(uint32_t bytes_per_second, uint32_t burst_bytes)
+{
+    budget_rate = bytes_per_second;
+    budget_burst = burst_bytes;
+    budget_tokens = burst_bytes;
+    budget_last_ms = millis();
+    budget_remainder = 0;
+    budget_seen_bytes = bytes_written;
+}
+
+bool XMLWriter::queueTm(TMPriority_t priority)
+{
+    TMQueueEntry_t * entry;
+
+    // queue the frame being filled, producers move on to another
+    if (TM_FILLING != tm_frame->state) return false;
+
+    entry = tmqSlot(priority);
+    if (NULL == entry) return false;
+
+    flushTmBits();
+    tm_frame->state = TM_QUEUED;
+    entry->frame = tm_frame;
+    return true;
+}
+
+bool XMLWriter::queueTmString(TMPriority_t priority, StateFlag_t state_flag, const char * message)
+{
+    TMQueueEntry_t * entry = tmqSlot(priority);
+
+    if (NULL == entry) return false;
+
+    entry->frame = NULL;
+    entry->flag = state_flag;
+    copyField(entry->message, message, TMQ_MESSAGE_SIZE);
+    return true;
+}
+
+uint8_t XMLWriter::scheduleTm()
+{
+    TMQueueEntry_t * entry;
+    uint32_t now, cost, before;
+    uint64_t credit;
+    uint8_t num_sent = 0;
+
+    // refill the budget for the time elapsed, up to the burst size
+    now = millis();
+    if (0 != budget_rate) {
+        // in byte-ms, carrying the part of a byte not yet earned, so frequent
+        // calls at low rates still add up
+        credit = (uint64_t) (now - budget_last_ms) * budget_rate + budget_remainder;
+        budget_remainder = credit % 1000;
+        if ((int64_t) budget_tokens + (int64_t) (credit / 1000) >= (int64_t) budget_burst) {
+            budget_tokens = budget_burst;
+            budget_remainder = 0;
+        } else {
+            budget_tokens += (int32_t) (credit / 1000);
+        }
+
+        // charge everything written since, e.g. by direct TM(), IMR() or TCAck() calls
+        budget_tokens -= (int32_t) (bytes_written - budget_seen_bytes);
+    }
+    budget_last_ms = now;
+    budget_seen_bytes = bytes_written;
+
+    while (NULL != (entry = tmqNext())) {
+        // don't block behind a message that's still going out
+        if (tmPending()) break;
+
+        // strict priority: if the most urgent message doesn't fit, nothing else goes
+        cost = TMQ_XML_OVERHEAD + (NULL == entry->frame ? strlen(entry->message) : entry->frame->length + 10);
+        if (0 != budget_rate && budget_tokens < (int32_t) cost && budget_tokens < (int32_t) budget_burst) break;
+
+        before = bytes_written;
+        if (NULL == entry->frame) {
+            TM_String(entry->flag, entry->message);
+        } else {
+            sendFrame(entry->frame);
+        }
+
+        // charge what was actually written, plus what's still queued for pump(),
+        // which isn't charged again when it's written
+        cost = bytes_written - before;
+        if (tmPending()) cost += tx_total - tx_sent;
+        if (0 != budget_rate) budget_tokens -= cost;
+        budget_seen_bytes = before + cost;
+
+        tmqRemove(entry);
+        num_sent++;
+    }
+
+    return num_sent;
+}
+
+uint8_t XMLWriter::getTmQueueDepth()
+{
+    uint8_t depth = 0;
+
+    for (uint8_t i = 0; i < TMQ_SIZE; i++) {
+        if (tm_queue[i].used) depth++;
+    }
+
+    return depth;
+}
+
+uint16_t XMLWriter::getTmQueueDropped()
+{
+    return tmq_dropped;
+}
+
+uint32_t XMLWriter::getBytesWritten()
+{
+    return bytes_written;
+}
+
+// most urgent, then oldest, queued entry
+TMQueueEntry_t * XMLWriter::tmqNext()
+{
+    TMQueueEntry_t * next = NULL;
+
+    for (uint8_t i = 0; i < TMQ_SIZE; i++) {
+        if (!tm_queue[i].used) continue;
+
+        if (NULL == next || tm_queue[i].priority < next->priority ||
+            (tm_queue[i].priority == next->priority && tm_queue[i].seq < next->seq)) {
+            next = &tm_queue[i];
+        }
+    }
+
+    return next;
+}
+
+// claims a free entry, dropping the least urgent, newest entry if the queue
+// is full and it's less urgent than the new one
+TMQueueEntry_t * XMLWriter::tmqSlot(TMPriority_t priority)
+{
+    TMQueueEntry_t * victim = NULL;
+    TMQueueEntry_t * slot = NULL;
+
+    if (priority >= NUM_TM_PRIORITIES) return NULL;
+
+    for (uint8_t i = 0; i < TMQ_SIZE; i++) {
+        if (!tm_queue[i].used) {
+            slot = &tm_queue[i];
+            break;
+        }
+
+        if (NULL == victim || tm_queue[i].priority > victim->priority ||
+            (tm_queue[i].priority == victim->priority && tm_queue[i].seq > victim->seq)) {
+            victim = &tm_queue[i];
+        }
+    }
+
+    if (NULL == slot) {
+        if (NULL == victim || victim->priority <= priority) return NULL;
+        tmqRemove(victim);
+        tmq_dropped++;
+        slot = victim;
+    }
+
+    slot->used = true;
+    slot->priority = priority;
+    slot->seq = ++tmq_seq;
+    return slot;
+}
+
+void XMLWriter::tmqRemove(TMQueueEntry_t * entry)
+{
+    // a dropped frame is free to reuse
+    if (NULL != entry->frame && TM_QUEUED == entry->frame->state) {
+        entry->frame->state = TM_ACKED;
+    }
+
+    entry->frame = NULL;
+    entry->used = false;
+}
+
+// --------------------------------------------------------
+// Segmented telemetry transfers
+// --------------------------------------------------------
+
+bool XMLWriter::startSegmentedTm(TMSource_t source, void * context, uint32_t total_length, uint16_t transfer_id)
+{
+    uint16_t per_segment = tm_capacity - TMSegmentRecord::size;
+
+    // the segment count has to fit its 16-bit header field
+    if (NULL == source || total_length > 65535UL * per_segment) return false;
+
+    seg_source = source;
+    seg_context = context;
+    seg_total = total_length;
+    seg_sent = 0;
+    seg_index = 0;
+    seg_id = transfer_id;
+    seg_per_segment = per_segment;
+    seg_count = (uint16_t) ((total_length + per_segment - 1) / per_segment);
+    seg_active = true;
+
+    return true;
+}
+
+bool XMLWriter::sendNextSegment()
+{
+    TMSegmentHeader_t header;
+    uint16_t space, request, received;
+    uint8_t * out;
+
+    if (!seg_active) return false;
+
+    // each segment gets a fresh frame
+    clearTm();
+
+    // no free frame yet (e.g. one buffer, with an asynchronous TM going out),
+    // the transfer stays active to be tried again
+    space = tmSpace();
+    if (space <= TMSegmentRecord::size) return false;
+
+    // every segment but the last is the size the count was computed from
+    request = seg_per_segment;
+    if (0 != seg_total && seg_total - seg_sent < request) {
+        request = seg_total - seg_sent;
+    }
+
+    // the capacity shrank (compression was enabled) since the transfer started
+    if (space - TMSegmentRecord::size < request) {
+        seg_active = false;
+        return false;
+    }
+
+    out = tmReserve(TMSegmentRecord::size + request);
+    if (NULL == out) {
+        seg_active = false;
+        return false;
+    }
+
+    // pull the data in place, after the header
+    received = seg_source(out + TMSegmentRecord::size, request, seg_context);
+    if (received > request) received = request;
+
+    // a known-length transfer can't come up short, or the count would be wrong
+    if (0 != seg_total && received < request) {
+        seg_active = false;
+        return false;
+    }
+
+    header.transfer_id = seg_id;
+    header.index = seg_index;
+    header.count = seg_count;
+    header.offset = seg_sent;
+    header.flags = 0;
+
+    seg_sent += received;
+    if ((0 != seg_total && seg_sent >= seg_total) || (0 == seg_total && received < request)) {
+        header.flags |= TMSEG_LAST;
+        seg_active = false;
+    }
+
+    TMSegmentRecord::pack(header, out);
+    tmCommit(TMSegmentRecord::size + received);
+    seg_index++;
+
+    TM();
+    return true;
+}
+
+bool XMLWriter::segmentedTmActive()
+{
+    return seg_active;
+}
+
+uint32_t XMLWriter::segmentedBytesSent()
+{
+    return seg_sent;
+}
+
+uint32_t XMLWriter::segmentedBytesTotal()
+{
+    return seg_total;
+}
+
+uint16_t XMLWriter::segmentedTmIndex()
+{
+    return seg_index;
+}
+
+// --------------------------------------------------------
+// Asynchronous telemetry transmission
+// --------------------------------------------------------
+
+void XMLWriter::setAsyncTM(bool async)
+{
+    // don't leave a queued message behind when switching back to blocking
+    if (!async) finishTM();
+
+    async_tm = async;
+}
+
+bool XMLWriter::pump()
+{
+    int space;
+
+    drainLog();
+
+    while (tmPending()) {
+        space = _stream->availableForWrite();
+        if (space <= 0) return false;
+
+        writeSegment((uint16_t) space);
+    }
+
+    return true;
+}
+
+void XMLWriter::finishTM()
+{
+    while (tmPending()) {
+        writeSegment(TMBUF_MAXSIZE);
+    }
+}
+
+bool XMLWriter::tmPending()
+{
+    return tx_segment < TX_NUM_SEGMENTS;
+}
+
+uint16_t XMLWriter::tmBytesSent()
+{
+    return tx_sent;
+}
+
+uint16_t XMLWriter::tmBytesTotal()
+{
+    return tx_total;
+}
+
+// write up to max_bytes of the current segment, moving on when it completes
+void XMLWriter::writeSegment(uint16_t max_bytes)
+{
+    uint16_t chunk = tx_lengths[tx_segment] - tx_index;
+
+    if (chunk > max_bytes) chunk = max_bytes;
+
+    if (0 != chunk) {
+#ifdef WRITER_STATS
+        uint32_t start_us = micros();
+#endif
+        _stream->write(tx_segments[tx_segment] + tx_index, chunk);
+#ifdef WRITER_STATS
+        // only TMs are queued, with any XML as the first segment
+        statWrite(STAT_TM, 0 != tx_segment, chunk, start_us);
+#endif
+        logBytes(tx_segments[tx_segment] + tx_index, chunk);
+        tx_index += chunk;
+        tx_sent += chunk;
+        bytes_written += chunk;
+    }
+
+    if (tx_index == tx_lengths[tx_segment]) {
+        tx_index = 0;
+        tx_segment++;
+    }
+
+    // the XML buffer is free once the whole message is out
+    if (!tmPending()) {
+        num_xml_elements = 0;
+    }
+}
+
 // --------------------------------------------------------
 // Telemetry buffer interface functions
 // --------------------------------------------------------
@@ -563,76 +1552,420 @@ bool XMLWriter::addTm(uint32_t inDouble)
     return addTMByte(outChar);
 }
 
-bool XMLWriter::addTm(String inStr)
+bool XMLWriter::addTm(const String & inStr)
 {
-    bool err = false;
-    for (uint8_t i = 0; i < inStr.length(); i++) {
-        err = addTm((uint8_t)inStr.charAt(i));
-#ifdef TM_DEBUG
-        _stream->print((uint8_t)inStr.charAt(i));
-#endif
-        if (err)
-            break;
-    }
-    return err;
+    return addTm(inStr.c_str(), inStr.length());
+}
+
+bool XMLWriter::addTm(const char * inStr)
+{
+    if (NULL == inStr) return false;
+
+    return addTm(inStr, strlen(inStr));
+}
+
+bool XMLWriter::addTm(const char * inStr, uint16_t length)
+{
+    return addTm((const uint8_t *) inStr, length);
 }
 
 bool XMLWriter::addTm(const uint8_t * buffer, uint16_t size)
 {
+    uint16_t num_added;
+
+    if (NULL == buffer) return false;
+
+    // add as much as fits, as a single block
+    num_added = tmSpace();
+    if (size < num_added) num_added = size;
+
+    memcpy(tm_frame->data + tm_frame->length, buffer, num_added);
+    tm_frame->crc = crcBlock(tm_frame->crc, tm_frame->data + tm_frame->length, num_added);
+    tm_frame->length += num_added;
+
+    return num_added == size;
+}
+
+bool XMLWriter::addTm(const uint16_t * buffer, uint16_t size)
+{
+    uint16_t start;
+    uint8_t * out = NULL;
+    bool success = true;
+
     if (NULL == buffer) return false;
 
+    // fast path when the whole array fits
+    if (2 * (uint32_t) size <= TMBUF_MAXSIZE) out = tmReserve(2 * size);
+    if (NULL != out) {
+        for (uint16_t i = 0; i < size; i++) {
+            putWord(out + 2 * i, buffer[i]);
+        }
+        tmCommit(2 * size);
+        return true;
+    }
+
+    // otherwise, add as many bytes as fit
+    // move on from a sent frame before marking where the new words start
+    tmSpace();
+    start = tm_frame->length;
+
+    for (uint16_t i = 0; i < size && success; i++) {
+        success = (tm_capacity != tm_frame->length);
+        if (success) tm_frame->data[tm_frame->length++] = buffer[i] >> 8;
+
+        success = success && (tm_capacity != tm_frame->length);
+        if (success) tm_frame->data[tm_frame->length++] = (buffer[i] & 0xFF);
+    }
+
+    // crc the words added as a single block
+    tm_frame->crc = crcBlock(tm_frame->crc, tm_frame->data + start, tm_frame->length - start);
+
+    return success;
+}
+
+bool XMLWriter::addTm(int16_t inWord)
+{
+    uint8_t * out = tmReserve(2);
+
+    if (NULL == out) return false;
+
+    putWord(out, (uint16_t) inWord);
+    tmCommit(2);
+    return true;
+}
+
+bool XMLWriter::addTm(int32_t inDouble)
+{
+    uint8_t * out = tmReserve(4);
+
+    if (NULL == out) return false;
+
+    putLong(out, (uint32_t) inDouble);
+    tmCommit(4);
+    return true;
+}
+
+bool XMLWriter::addTm(float inFloat)
+{
+    uint8_t * out = tmReserve(4);
+
+    if (NULL == out) return false;
+
+    putLong(out, floatBits(inFloat));
+    tmCommit(4);
+    return true;
+}
+
+bool XMLWriter::addTm(const int16_t * buffer, uint16_t size)
+{
+    uint8_t * out;
+
+    if (NULL == buffer || 2 * (uint32_t) size > TMBUF_MAXSIZE) return false;
+    if (NULL == (out = tmReserve(2 * size))) return false;
+
     for (uint16_t i = 0; i < size; i++) {
-        if (!addTMByte(buffer[i])) return false;
+        putWord(out + 2 * i, (uint16_t) buffer[i]);
     }
 
+    tmCommit(2 * size);
     return true;
 }
 
-bool XMLWriter::addTm(const uint16_t * buffer, uint16_t size)
+bool XMLWriter::addTm(const uint32_t * buffer, uint16_t size)
 {
-    uint8_t outChar;
+    uint8_t * out;
 
-    if (NULL == buffer) return false;
+    if (NULL == buffer || 4 * (uint32_t) size > TMBUF_MAXSIZE) return false;
+    if (NULL == (out = tmReserve(4 * size))) return false;
+
+    for (uint16_t i = 0; i < size; i++) {
+        putLong(out + 4 * i, buffer[i]);
+    }
+
+    tmCommit(4 * size);
+    return true;
+}
+
+bool XMLWriter::addTm(const int32_t * buffer, uint16_t size)
+{
+    uint8_t * out;
+
+    if (NULL == buffer || 4 * (uint32_t) size > TMBUF_MAXSIZE) return false;
+    if (NULL == (out = tmReserve(4 * size))) return false;
 
     for (uint16_t i = 0; i < size; i++) {
-        outChar = buffer[i] >> 8;
-        if (!addTMByte(outChar)) return false;
+        putLong(out + 4 * i, (uint32_t) buffer[i]);
+    }
+
+    tmCommit(4 * size);
+    return true;
+}
+
+bool XMLWriter::addTm(const float * buffer, uint16_t size)
+{
+    uint8_t * out;
+
+    if (NULL == buffer || 4 * (uint32_t) size > TMBUF_MAXSIZE) return false;
+    if (NULL == (out = tmReserve(4 * size))) return false;
 
-        outChar = (buffer[i] & 0xFF);
-        if (!addTMByte(outChar)) return false;
+    for (uint16_t i = 0; i < size; i++) {
+        putLong(out + 4 * i, floatBits(buffer[i]));
     }
 
+    tmCommit(4 * size);
+    return true;
+}
+
+bool XMLWriter::addTmVarint(uint32_t value)
+{
+    uint16_t space = tmSpace();
+    uint8_t len = TMEncodeVarint(value, tm_frame->data + tm_frame->length, space);
+
+    if (0 == len) return false;
+
+    tmCommit(len);
+    return true;
+}
+
+bool XMLWriter::addTmZigZag(int32_t value)
+{
+    return addTmVarint(TMZigZag(value));
+}
+
+bool XMLWriter::addTmDelta(const uint16_t * samples, uint16_t count)
+{
+    uint16_t space = tmSpace();
+    uint16_t len;
+
+    if (NULL == samples) return false;
+    if (0 == count) return true;
+
+    len = TMEncodeDelta(samples, count, tm_frame->data + tm_frame->length, space);
+    if (0 == len) return false;
+
+    tmCommit(len);
+    return true;
+}
+
+bool XMLWriter::addTmDelta(const int32_t * samples, uint16_t count)
+{
+    uint16_t space = tmSpace();
+    uint16_t len;
+
+    if (NULL == samples) return false;
+    if (0 == count) return true;
+
+    len = TMEncodeDelta(samples, count, tm_frame->data + tm_frame->length, space);
+    if (0 == len) return false;
+
+    tmCommit(len);
+    return true;
+}
+
+bool XMLWriter::addTmDeltaDelta(const uint32_t * times, uint16_t count)
+{
+    uint16_t space = tmSpace();
+    uint16_t len;
+
+    if (NULL == times) return false;
+    if (0 == count) return true;
+
+    len = TMEncodeDeltaDelta(times, count, tm_frame->data + tm_frame->length, space);
+    if (0 == len) return false;
+
+    tmCommit(len);
+    return true;
+}
+
+bool XMLWriter::addTmBits(uint32_t value, uint8_t nbits)
+{
+    uint16_t start;
+
+    if (0 == nbits || nbits > 32) return false;
+
+    // room for every byte this completes, and the partial byte after it
+    if (tmBitSpace() < (tm_bit_count + nbits + 7) / 8) return false;
+
+    start = tm_frame->length;
+    pushBits(value, nbits);
+    tm_frame->crc = crcBlock(tm_frame->crc, tm_frame->data + start, tm_frame->length - start);
     return true;
 }
 
+bool XMLWriter::addTmBits(const uint16_t * samples, uint16_t count, uint8_t nbits)
+{
+    uint16_t mask;
+    uint16_t start;
+    uint32_t acc;
+    uint8_t acc_bits;
+    uint8_t * out;
+
+    if (NULL == samples || 0 == nbits || nbits > 16) return false;
+    mask = (uint16_t) ((1UL << nbits) - 1);
+
+    // single capacity check for the whole array
+    if (tmBitSpace() < (tm_bit_count + (uint32_t) count * nbits + 7) / 8) return false;
+
+    // pack through a wider local accumulator, seeded with the pending bits
+    start = tm_frame->length;
+    out = tm_frame->data + start;
+    acc = tm_bit_acc;
+    acc_bits = tm_bit_count;
+    for (uint16_t i = 0; i < count; i++) {
+        acc = (acc << nbits) | (samples[i] & mask);
+        acc_bits += nbits;
+
+        while (acc_bits >= 8) {
+            acc_bits -= 8;
+            *out++ = (uint8_t) (acc >> acc_bits);
+        }
+    }
+
+    tm_bit_acc = (uint8_t) (acc & ((1 << acc_bits) - 1));
+    tm_bit_count = acc_bits;
+    tm_frame->length = out - tm_frame->data;
+    tm_frame->crc = crcBlock(tm_frame->crc, tm_frame->data + start, tm_frame->length - start);
+    return true;
+}
+
+void XMLWriter::flushTmBits()
+{
+    if (0 == tm_bit_count) return;
+
+    // zero-pad the partial byte, space for it was reserved when the bits were added
+    uint8_t last_byte = tm_bit_acc << (8 - tm_bit_count);
+    tm_bit_acc = 0;
+    tm_bit_count = 0;
+    addTMByte(last_byte);
+}
+
 void XMLWriter::clearTm()
 {
-    num_tm_elements = 0;
-    tm_buff_sent = false;
+    // a sent frame is retained, move on to another one instead
+    if (TM_FILLING != tm_frame->state) {
+        nextTmFrame();
+        return;
+    }
+
+    tm_frame->length = 0;
+    tm_frame->crc = reset_crc;
+    tm_bit_acc = 0;
+    tm_bit_count = 0;
 }
 
 uint16_t XMLWriter::getTmLen()
 {
-    return num_tm_elements;
+    return tm_frame->length;
 }
 
 uint16_t XMLWriter::getTmBuffer(uint8_t ** buffer)
 {
-    *buffer = tm_buffer;
-    return num_tm_elements;
+    *buffer = tm_frame->data;
+    return tm_frame->length;
 }
 
-inline bool XMLWriter::addTMByte(uint8_t in_byte)
+uint16_t XMLWriter::getTmCrc()
+{
+    return tm_frame->crc;
+}
+
+// select the frame for producers to fill, preferring free frames and
+// reclaiming the oldest retained frame otherwise
+bool XMLWriter::nextTmFrame()
 {
-    // if we're adding to the buffer after it's been sent, reset it
-    if (tm_buff_sent) {
-        tm_buff_sent = false;
-        num_tm_elements = 0;
+    TMFrame_t * frame = NULL;
+    TMFrame_t * oldest = NULL;
+
+    for (uint8_t i = 0; i < TM_NUM_BUFFERS; i++) {
+        // the frame being transmitted can't change, nor can queued frames
+        if (tmPending() && tx_frame == &tm_frames[i]) continue;
+        if (TM_QUEUED == tm_frames[i].state) continue;
+
+        if (TM_ACKED == tm_frames[i].state || TM_FILLING == tm_frames[i].state) {
+            frame = &tm_frames[i];
+            break;
+        }
+
+        if (NULL == oldest || tm_frames[i].send_seq < oldest->send_seq) {
+            oldest = &tm_frames[i];
+        }
     }
 
-    if (TMBUF_MAXSIZE == num_tm_elements) return false;
+    if (NULL == frame) {
+        if (NULL == oldest) return false;
+        frame = oldest;
+        if (!spoolFrame(frame)) tm_dropped++;
+    }
+
+    tm_frame = frame;
+    tm_bit_acc = 0;
+    tm_bit_count = 0;
+    tm_frame->state = TM_FILLING;
+    tm_frame->msg_id = 0;
+    tm_frame->spool_seq = 0;
+    tm_frame->length = 0;
+    tm_frame->crc = reset_crc;
+    return true;
+}
+
+inline uint16_t XMLWriter::tmSpace()
+{
+    // byte appends start on a byte boundary
+    flushTmBits();
+
+    return tmBitSpace();
+}
+
+inline uint16_t XMLWriter::tmBitSpace()
+{
+    // if we're adding to the buffer after it's been sent, move to a free one
+    if (TM_FILLING != tm_frame->state && !nextTmFrame()) return 0;
+
+    if (tm_frame->length >= tm_capacity) return 0;
+
+    return tm_capacity - tm_frame->length;
+}
+
+// append bits MSB-first, writing each completed byte to the frame (not CRC'd)
+inline void XMLWriter::pushBits(uint32_t value, uint8_t nbits)
+{
+    uint8_t take;
+
+    while (0 != nbits) {
+        take = 8 - tm_bit_count;
+        if (take > nbits) take = nbits;
+        nbits -= take;
+
+        tm_bit_acc = (tm_bit_acc << take) | ((value >> nbits) & ((1 << take) - 1));
+        tm_bit_count += take;
+
+        if (8 == tm_bit_count) {
+            tm_frame->data[tm_frame->length++] = tm_bit_acc;
+            tm_bit_acc = 0;
+            tm_bit_count = 0;
+        }
+    }
+}
+
+uint8_t * XMLWriter::tmReserve(uint16_t size)
+{
+    if (tmSpace() < size) return NULL;
+
+    return tm_frame->data + tm_frame->length;
+}
+
+void XMLWriter::tmCommit(uint16_t size)
+{
+    tm_frame->crc = crcBlock(tm_frame->crc, tm_frame->data + tm_frame->length, size);
+    tm_frame->length += size;
+}
+
+inline bool XMLWriter::addTMByte(uint8_t in_byte)
+{
+    if (0 == tmSpace()) return false;
 
-    tm_buffer[num_tm_elements++] = in_byte;
+    tm_frame->crc = (tm_frame->crc << 8) ^ crc_table[(uint8_t) ((tm_frame->crc >> 8) ^ in_byte)];
+    tm_frame->data[tm_frame->length++] = in_byte;
     return true;
 }
 
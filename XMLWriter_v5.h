@@ -30,11 +30,51 @@
 #define XMLWRITER_H
 
 #include "InstInfo.h"
+#include "TMCompress.h"
+#include "TMEncode.h"
+#include "TMRecord.h"
+#include "TMSegment.h"
+#include "TMSpool.h"
 #include "Arduino.h"
 #include "TimeLib.h"
 
 #define TMBUF_MAXSIZE   8192
-//#define LOG
+#define XMLBUF_MAXSIZE  512
+
+// Fixed state field storage (including the null terminator)
+#define STATE_FLAG_SIZE     24
+#define STATE_DETAILS_SIZE  101
+
+// Number of TM frames: one is filled while sent frames await a TMAck
+#ifndef TM_NUM_BUFFERS
+#define TM_NUM_BUFFERS  2
+#endif
+
+// Sent TMs (frames and strings) remembered for matching TMAcks in order
+#ifndef TM_SENT_RING_SIZE
+#define TM_SENT_RING_SIZE  16
+#endif
+
+// Priority queue bounds: total entries, and the longest queued TM_String message
+#define TMQ_SIZE            8
+#define TMQ_MESSAGE_SIZE    101
+
+// Conservative XML overhead of a TM, used to check the budget before sending
+#define TMQ_XML_OVERHEAD    400
+
+// XML, "START", binary data, CRC + "END"
+#define TX_NUM_SEGMENTS 4
+
+// Longest fixed tail (after the Msg value) of a templated message
+#define MSG_SUFFIX_MAXSIZE  160
+
+// Bytes of written messages held for the log until it accepts them
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 1024
+#endif
+
+// Per message type counters of bytes and time spent writing to the stream
+//#define WRITER_STATS
 
 enum StateFlag_t {
     UNKN,
@@ -44,22 +84,121 @@ enum StateFlag_t {
     NOMESS
 };
 
+enum TMFrameState_t {
+    TM_FILLING, // being filled by addTm
+    TM_UNACKED, // sent, waiting for a TMAck
+    TM_NAKED,   // NAK'd, retained for retransmission
+    TM_ACKED,   // acknowledged, free to reuse
+    TM_QUEUED   // waiting in the priority queue
+};
+
+// Priority queue levels, most urgent first
+enum TMPriority_t {
+    TM_CRITICAL,
+    TM_ROUTINE,
+    TM_BULK,
+    NUM_TM_PRIORITIES
+};
+
+struct TMQueueEntry_t {
+    struct TMFrame_t * frame;   // NULL for a TM_String message
+    char message[TMQ_MESSAGE_SIZE];
+    StateFlag_t flag;
+    uint32_t seq;
+    TMPriority_t priority;
+    bool used;
+};
+
+#ifdef WRITER_STATS
+enum WriterMsg_t {
+    STAT_IMR,
+    STAT_S,
+    STAT_RA,
+    STAT_IMACK,
+    STAT_TCACK,
+    STAT_TM,
+    STAT_TM_STRING,
+    NUM_STAT_MSGS
+};
+
+struct WriterMsgStats_t {
+    uint32_t messages;
+    uint32_t xml_bytes;
+    uint32_t bin_bytes;
+    uint32_t write_us;     // total time in _stream->write
+    uint32_t max_write_us; // longest time a single message spent in _stream->write
+};
+
+struct WriterStats_t {
+    WriterMsgStats_t msg[NUM_STAT_MSGS];
+};
+#endif
+
+// The fixed-content messages, built once from templates
+enum MsgTemplateId_t {
+    TMPL_IMR,
+    TMPL_S,
+    TMPL_RA,
+    TMPL_IMACK,
+    TMPL_IMNAK,
+    TMPL_TCACK,
+    TMPL_TCNAK,
+    NUM_MSG_TEMPLATES
+};
+
+// A message is its prefix up to the Msg value, the value, and the suffix.
+// The CRC after the prefix is known, and the suffix's effect on the CRC is
+// linear in the state it starts from: crc = suffix_crc ^ (the suffix_shift
+// entries of the state's set bits), so only the Msg value is CRC'd per send.
+struct MsgTemplate_t {
+    const char * prefix;
+    uint8_t prefix_len;
+    uint16_t prefix_crc;
+    uint8_t suffix[MSG_SUFFIX_MAXSIZE];
+    uint8_t suffix_len;
+    uint16_t suffix_crc;
+    uint16_t suffix_shift[16];
+};
+
+struct TMFrame_t {
+    uint8_t data[TMBUF_MAXSIZE];
+    uint16_t length;
+    uint16_t crc;      // running binary crc, updated as data is added
+    uint16_t msg_id;   // Msg id of the last send
+    uint32_t send_seq; // send order, for matching in-order acks
+    uint32_t spool_seq; // spooled record the frame holds, 0 if none
+    TMFrameState_t state;
+};
+
+// A sent TM, in the order the OBC acknowledges them
+struct TMSent_t {
+    TMFrame_t * frame;  // NULL for a TM_String message
+    uint32_t send_seq;  // the frame's send_seq, stale once it's resent or reclaimed
+    uint16_t msg_id;
+};
+
 class XMLWriter {
 public:
-#ifdef LOG
-    XMLWriter(Print* stream, Print* log, Instrument_t inst);
-#else
     XMLWriter(Print* stream, Instrument_t inst);
-#endif
+
+    // Optional transcript of everything written to the stream. Bytes are
+    // buffered and written to the log only as it has room, so a slow log
+    // never blocks the OBC link; messages that don't fit are dropped.
+    void setLog(Print* log); // NULL detaches
+    uint16_t drainLog(); // non-blocking, also done after each write
+    void flushLog(); // blocks until the buffer is empty
+    uint32_t getLogDropped(); // bytes
 
     // Call to set names of state flags
-    void setStateFlags(uint8_t num, String flag);
+    void setStateFlags(uint8_t num, const char * flag);
+    void setStateFlags(uint8_t num, const String & flag);
 
     // Call to set values of state flags
     void setStateFlagValue(uint8_t num, StateFlag_t stat);
 
     // Call to set value of details
-    void setStateDetails(uint8_t num, String details);
+    void setStateDetails(uint8_t num, const char * details);
+    void setStateDetails(uint8_t num, const String & details);
 
     // Send specific messages
     void IMR();
@@ -72,16 +211,125 @@ public:
     void TM();
     void TM_String(StateFlag_t state_flag, const char * message);
 
+    // Sent frames are retained until acknowledged: pass each TMAck result
+    // to tmAck (returns the Msg id acked, 0 if none), and retransmit NAK'd
+    // frames without rebuilding them. TMAcks are matched to TMs, strings
+    // included, in the order they were sent.
+    uint16_t tmAck(bool ackval);
+    bool retransmitTm(); // oldest NAK'd frame
+    bool retransmitTm(uint16_t msg_id);
+    uint16_t getTmDropped(); // unacked frames reclaimed for new data
+
+    // Optional spool for TMs that can't be delivered (see TMSpool.h): with
+    // one attached, unacked frames are spooled instead of dropped when
+    // they're reclaimed, and spoolTm() spools the buffer being filled
+    // instead of sending it (e.g. while the link is down). drainSpool()
+    // sends the oldest spooled record as a TM once a frame is free, and
+    // tmAck() removes each record from the spool as it's acknowledged.
+    // Each append is synced to the storage before it returns, so addTm()
+    // calls that reclaim a frame, and spoolTm(), block for the sync.
+    void setSpool(TMSpool * spool); // NULL detaches
+    bool spoolTm(); // false if the buffer is empty or the spool is full
+    bool drainSpool(); // false if nothing was sent
+
+    // Priority queue with a downlink budget: queued messages are only sent
+    // by scheduleTm(), most urgent first, and only while the byte budget
+    // allows (a message larger than the burst size waits for a full bucket).
+    // Messages already on the wire aren't interrupted. A full queue makes
+    // room for a more urgent message by dropping the least urgent one.
+    // Queued TMs use the state flags/details at the time they're sent.
+    void setDownlinkBudget(uint32_t bytes_per_second, uint32_t burst_bytes); // 0 = unlimited
+    bool queueTm(TMPriority_t priority); // queues the buffer being filled
+    bool queueTmString(TMPriority_t priority, StateFlag_t state_flag, const char * message);
+    uint8_t scheduleTm(); // returns the number of messages sent
+    uint8_t getTmQueueDepth();
+    uint16_t getTmQueueDropped();
+    uint32_t getBytesWritten(); // all bytes written to the stream
+
+    // Segmented transfers for data larger than one TM (see TMSegment.h):
+    // each sendNextSegment() pulls the next buffer's worth from the source
+    // and sends it as a TM with a segment header. Pass total_length 0 if
+    // it isn't known; a known length is limited to 65535 segments, and the
+    // source must then fill every request. The TM buffer is used for the
+    // transfer, so don't add other data or enable compression until it
+    // completes.
+    bool startSegmentedTm(TMSource_t source, void * context, uint32_t total_length, uint16_t transfer_id);
+    bool sendNextSegment(); // false when there's no transfer, no free buffer yet, or the source fails
+    bool segmentedTmActive();
+    uint32_t segmentedBytesSent();
+    uint32_t segmentedBytesTotal();
+    uint16_t segmentedTmIndex(); // next segment to send
+
+    // Optional TM payload compression: each binary section is prefixed with
+    // a TMCompress.h header, and LZF-compressed when that makes it smaller
+    void setTmCompression(bool enable);
+
+    // Asynchronous TM: TM() queues the message and pump() writes what the
+    // stream will accept without blocking, returning true once it's all sent
+    void setAsyncTM(bool async);
+    bool pump();
+    void finishTM(); // blocks until any queued TM is written
+    bool tmPending();
+    uint16_t tmBytesSent();
+    uint16_t tmBytesTotal();
+
     // Interacting with telemetry buffer
     bool addTm(uint8_t inChar);
     bool addTm(uint16_t inWord);
     bool addTm(uint32_t inDouble);
-    bool addTm(String inStr);
+    bool addTm(const String & inStr);
+    bool addTm(const char * inStr);
+    bool addTm(const char * inStr, uint16_t length);
     bool addTm(const uint8_t * buffer, uint16_t size);
     bool addTm(const uint16_t * buffer, uint16_t size);
+
+    // Typed big-endian appends: all-or-nothing, with a single capacity check
+    bool addTm(int16_t inWord);
+    bool addTm(int32_t inDouble);
+    bool addTm(float inFloat);
+    bool addTm(const int16_t * buffer, uint16_t size);
+    bool addTm(const uint32_t * buffer, uint16_t size);
+    bool addTm(const int32_t * buffer, uint16_t size);
+    bool addTm(const float * buffer, uint16_t size);
+
+    // Compact time-series appends (see TMEncode.h): all-or-nothing, each
+    // block is self-contained within the TM and doesn't encode its count
+    bool addTmVarint(uint32_t value);
+    bool addTmZigZag(int32_t value);
+    bool addTmDelta(const uint16_t * samples, uint16_t count);
+    bool addTmDelta(const int32_t * samples, uint16_t count);
+    bool addTmDeltaDelta(const uint32_t * times, uint16_t count);
+
+    // Bit-level appends, MSB-first (see TMEncode.h): fields aren't padded
+    // until flushTmBits, which is automatic before byte appends and sends
+    bool addTmBits(uint32_t value, uint8_t nbits); // nbits 1-32
+    bool addTmBits(const uint16_t * samples, uint16_t count, uint8_t nbits); // nbits 1-16
+    void flushTmBits();
+
+    // Pack a whole struct described by a TMRecord (see TMRecord.h) in one
+    // bounds-checked step, all-or-nothing
+    template <typename Record, typename S>
+    bool addTmRecord(const S & record)
+    {
+        uint8_t * out = tmReserve(Record::size);
+
+        if (NULL == out) return false;
+
+        Record::pack(record, out);
+        tmCommit(Record::size);
+        return true;
+    }
+
     void clearTm();
     uint16_t getTmLen();
-    uint16_t getTmBuffer(uint8_t ** buffer);
+    uint16_t getTmBuffer(uint8_t ** buffer); // don't modify the contents, the CRC is kept as data is added
+    uint16_t getTmCrc(); // binary section CRC of the current buffer contents
+
+#ifdef WRITER_STATS
+    // Counters indexed by WriterMsg_t, retransmissions count as TMs
+    const WriterStats_t & getStats();
+    void resetStats();
+#endif
 
 private:
     void reset();
@@ -92,16 +340,35 @@ private:
     // Returns current crc
     uint16_t crcValue();
 
-    // Write the new byte over serial, and update the CRC
-    void writeAndUpdateCRC(uint8_t data);
-    void writeAndUpdateCRC(uint8_t* data, uint8_t length);
-    void writeAndUpdateCRC(const char* data);
+    // Add to the XML message buffer (CRC'd and sent when the message is complete)
+    void bufferXML(uint8_t data);
+    void bufferXML(uint8_t* data, uint8_t length);
+    void bufferXML(const char* data);
 
-    // Writes crc node and resets crc value
+    // Write the buffered XML to the stream in a single call
+    void flushXML();
+
+    // Update the working crc over a block of bytes
+    void crcUpdate(const uint8_t * data, uint16_t length);
+
+    // CRCs the buffered message, writes it with the crc node, and resets crc value
     void writeCRC();
 
+    // CRCs the buffered message and adds the crc node without writing
+    void bufferCRC();
+
+    // Adds the crc node for the current crc value
+    void bufferCRCNode();
+
+    // Precomputed short messages
+    MsgTemplate_t templates[NUM_MSG_TEMPLATES];
+    void buildTemplates();
+    void buildSuffix(MsgTemplateId_t id);
+    void sendTemplate(MsgTemplateId_t id);
+
     // Sends Msg node
     uint16_t msgNode();
+    uint16_t nextMsgCount(); // returns the count to send, then advances it
 
     // Sends Inst Node
     void instNode();
@@ -113,15 +380,27 @@ private:
 
     // \t<field>value</field>
     void writeNode(const char* tag, const char* value); //string
-    void writeNode(const char* tag, String value);
     void writeNode(const char* tag, char* value, uint8_t length); //char array
     void writeNode(const char* tag, uint8_t value);
-    void writeNode(String tag, String value);
-    void writeNode(String tag, const char* value);
+    void writeNode(const char* tag, uint16_t value); //decimal
+
+    // Sends a TM message with the frame as its binary section
+    void sendFrame(TMFrame_t * frame);
+
+    // Priority queue internals
+    TMQueueEntry_t * tmqNext();
+    TMQueueEntry_t * tmqSlot(TMPriority_t priority);
+    void tmqRemove(TMQueueEntry_t * entry);
+
+    // Compresses and flags the frame's payload when compression is enabled
+    void packFrame(TMFrame_t * frame, const uint8_t ** payload, uint16_t * length, uint16_t * bin_crc);
 
     // Creates and wraps binary section
-    // Called from TM
-    void sendBin();
+    // Called from sendFrame
+    void sendBin(TMFrame_t * frame, const uint8_t * payload, uint16_t length, uint16_t binCrc);
+
+    // writes up to max_bytes of the queued TM
+    void writeSegment(uint16_t max_bytes);
 
     // sends an empty binary section
     void sendEmptyBin();
@@ -131,32 +410,112 @@ private:
 
     // internal interaction with the tm buffer
     bool addTMByte(uint8_t in_byte);
+    uint16_t tmSpace(); // moves on from a sent frame, returns free bytes
+    uint16_t tmBitSpace(); // as above, without flushing pending bits
+    void pushBits(uint32_t value, uint8_t nbits); // no capacity check
+    uint8_t * tmReserve(uint16_t size); // NULL if size bytes don't fit
+    void tmCommit(uint16_t size); // CRCs and keeps the reserved bytes
+    bool nextTmFrame();
+    bool spoolFrame(TMFrame_t * frame); // keeps a reclaimed frame's data
+    void recordSent(TMFrame_t * frame, uint16_t msg_id);
 
     // output streams
     Print* _stream;
-    Print* _log;
+    Print* _log = NULL;
+
+    // log ring buffer, log_count bytes starting at log_tail
+    uint8_t log_ring[LOG_RING_SIZE];
+    uint16_t log_tail = 0;
+    uint16_t log_count = 0;
+    uint32_t log_dropped = 0;
+    void logBytes(const uint8_t * data, uint16_t length);
+    uint16_t writeLog(uint16_t max_bytes);
 
     // working crc to transmit for both XML and binary sections
     uint16_t tx_crc;
 
+    // XML message assembly buffer
+    uint8_t xml_buffer[XMLBUF_MAXSIZE];
+    uint16_t num_xml_elements = 0;
+
     // Instrument id
     Instrument_t instrument;
 
     // Telemetry state fields
-    String StateFlag1 = "StateFlag1";
-    String StateFlag2 = "StateFlag2";
-    String StateFlag3 = "StateFlag3";
+    char StateFlag1[STATE_FLAG_SIZE] = "StateFlag1";
+    char StateFlag2[STATE_FLAG_SIZE] = "StateFlag2";
+    char StateFlag3[STATE_FLAG_SIZE] = "StateFlag3";
     StateFlag_t flag1 = FINE;
     StateFlag_t flag2 = NOMESS; //Only the first one is mandatory
     StateFlag_t flag3 = NOMESS;
-    String details1 = "";
-    String details2 = "";
-    String details3 = "";
-
-    // Telemetry buffer
-    uint8_t tm_buffer[TMBUF_MAXSIZE];
-    uint16_t num_tm_elements = 0;
-    bool tm_buff_sent = false;
+    char details1[STATE_DETAILS_SIZE] = "";
+    char details2[STATE_DETAILS_SIZE] = "";
+    char details3[STATE_DETAILS_SIZE] = "";
+
+    // Telemetry frames
+    TMFrame_t tm_frames[TM_NUM_BUFFERS];
+    TMFrame_t * tm_frame; // being filled
+    uint32_t tm_send_seq = 0;
+    TMSent_t tm_sent[TM_SENT_RING_SIZE];
+    uint32_t tm_sent_count = 0;  // TMs sent, indexes tm_sent
+    uint32_t tm_acked_count = 0; // TMAcks matched against them
+    uint16_t tm_dropped = 0;
+    uint16_t tm_capacity = TMBUF_MAXSIZE;
+    TMSpool * tm_spool = NULL;
+
+    // Pending bits (MSB-aligned in the low tm_bit_count bits) not yet in the frame
+    uint8_t tm_bit_acc = 0;
+    uint8_t tm_bit_count = 0;
+
+    // Priority queue and downlink budget
+    TMQueueEntry_t tm_queue[TMQ_SIZE];
+    uint32_t tmq_seq = 0;
+    uint16_t tmq_dropped = 0;
+    uint32_t budget_rate = 0;
+    uint32_t budget_burst = 0;
+    int32_t budget_tokens = 0;
+    uint32_t budget_last_ms = 0;
+    uint32_t budget_remainder = 0; // byte-ms earned toward the next byte
+    uint32_t budget_seen_bytes = 0; // bytes_written already charged to the budget
+    uint32_t bytes_written = 0;
+
+#ifdef WRITER_STATS
+    // Counters, and the type and write time so far of the message being sent
+    WriterStats_t stats;
+    WriterMsg_t stat_msg = STAT_IMR;
+    uint32_t stat_msg_us = 0;
+    void statBegin(WriterMsg_t msg);
+    void statWrite(WriterMsg_t msg, bool binary, uint16_t bytes, uint32_t start_us);
+#endif
+
+    // Segmented transfer
+    TMSource_t seg_source = NULL;
+    void * seg_context = NULL;
+    uint32_t seg_total = 0;
+    uint32_t seg_sent = 0;
+    uint16_t seg_index = 0;
+    uint16_t seg_count = 0;
+    uint16_t seg_per_segment = 0; // data bytes in each segment but the last
+    uint16_t seg_id = 0;
+    bool seg_active = false;
+
+    // Payload compression
+    bool tm_compression = false;
+    TMCompressState_t tm_comp_state;
+    uint8_t tm_packed[TMBUF_MAXSIZE];
+
+    // Queued TM transmission
+    bool async_tm = false;
+    uint8_t tm_start[5 + TMC_LZF_HEADER_SIZE] = {'S', 'T', 'A', 'R', 'T'};
+    uint8_t tm_start_len = 5;
+    uint8_t tm_trailer[5];
+    TMFrame_t * tx_frame = NULL;
+    const uint8_t * tx_segments[TX_NUM_SEGMENTS];
+    uint16_t tx_lengths[TX_NUM_SEGMENTS];
+    uint8_t tx_segment = TX_NUM_SEGMENTS; // none queued
+    uint16_t tx_index = 0;
+    uint16_t tx_sent = 0;
+    uint16_t tx_total = 0;
 
     uint16_t messCount = 1;
 
@@ -0,0 +1,68 @@
+/*  TM_BitPacking_Benchmark.ino
+ *  Created: October 2026
+ *
+ *  Measures the throughput of packing 12-bit ADC samples into the TM buffer
+ *  one field at a time and as a bulk array, and of unpacking them, and
+ *  verifies that the samples round-trip.
+ */
+
+#include <XMLWriter_v5.h>
+
+#define NUM_SAMPLES 5400 // 12-bit samples that fit in one TM
+#define SAMPLE_BITS 12
+
+XMLWriter writer(&Serial, LPC);
+uint16_t samples[NUM_SAMPLES];
+uint16_t unpacked[NUM_SAMPLES];
+
+void report(const char * name, uint32_t elapsed_us)
+{
+  Serial.print(name); Serial.print(": "); Serial.print(elapsed_us); Serial.print(" us, ");
+  Serial.print((float) NUM_SAMPLES / elapsed_us); Serial.println(" Msamples/s");
+}
+
+void setup()
+{
+  uint32_t start;
+  uint8_t * buffer;
+  uint16_t length;
+
+  Serial.begin(115200);
+  delay(3000);
+
+  for (int i = 0; i < NUM_SAMPLES; i++) {
+    samples[i] = 2048 + 700 * sin(i / 50.0f);
+  }
+
+  // one field per call
+  writer.clearTm();
+  start = micros();
+  for (int i = 0; i < NUM_SAMPLES; i++) {
+    writer.addTmBits(samples[i], SAMPLE_BITS);
+  }
+  writer.flushTmBits();
+  report("addTmBits (per sample)", micros() - start);
+
+  // bulk array
+  writer.clearTm();
+  start = micros();
+  writer.addTmBits(samples, NUM_SAMPLES, SAMPLE_BITS);
+  writer.flushTmBits();
+  report("addTmBits (array)", micros() - start);
+
+  length = writer.getTmBuffer(&buffer);
+  Serial.print("Packed "); Serial.print(NUM_SAMPLES); Serial.print(" samples into ");
+  Serial.print(length); Serial.print(" bytes (vs "); Serial.print(2 * NUM_SAMPLES); Serial.println(" as words)");
+
+  start = micros();
+  TMUnpackBits(buffer, length, SAMPLE_BITS, unpacked, NUM_SAMPLES);
+  report("TMUnpackBits", micros() - start);
+
+  if (0 != memcmp(samples, unpacked, sizeof(samples))) {
+    Serial.println("ERROR: round trip failed");
+  }
+}
+
+void loop()
+{
+}
@@ -0,0 +1,55 @@
+/*  TM_Budget_Test.ino
+ *  Created: October 2026
+ *
+ *  Checks that the downlink budget refills at its set rate when scheduleTm()
+ *  is called every millisecond: a low rate earns less than a byte per call,
+ *  which must still add up. The queue is kept full for TEST_SECONDS, then
+ *  the bytes written are compared against burst + rate * time. Writes go to
+ *  a counting sink, not the OBC.
+ */
+
+#include <XMLWriter_v5.h>
+
+#define BUDGET_RATE   200   // bytes/s
+#define BUDGET_BURST  4000  // bytes
+#define TEST_SECONDS  60
+
+// counts the bytes that would go to the OBC
+class CountingSink : public Print {
+public:
+  size_t write(uint8_t) { count++; return 1; }
+  size_t write(const uint8_t * buffer, size_t size) { count += size; return size; }
+  uint32_t count = 0;
+};
+
+CountingSink sink;
+XMLWriter writer(&sink, LPC);
+
+void setup()
+{
+  const char * payload = "budget test payload";
+  uint32_t start, elapsed_ms, allowed, num_sent = 0;
+
+  Serial.begin(115200);
+  delay(3000);
+
+  writer.setDownlinkBudget(BUDGET_RATE, BUDGET_BURST);
+  start = millis();
+  while ((elapsed_ms = millis() - start) < TEST_SECONDS * 1000UL) {
+    while (writer.getTmQueueDepth() < 4) writer.queueTmString(TM_BULK, FINE, payload);
+
+    num_sent += writer.scheduleTm();
+    delay(1);
+  }
+
+  // everything allowed should have gone out, short of one message's conservative cost
+  allowed = BUDGET_BURST + (uint32_t) ((uint64_t) elapsed_ms * BUDGET_RATE / 1000);
+  Serial.print(num_sent); Serial.print(" TMs, "); Serial.print(sink.count);
+  Serial.print(" bytes in "); Serial.print(elapsed_ms); Serial.print(" ms, ");
+  Serial.print(allowed); Serial.println(" allowed");
+  Serial.println((sink.count <= allowed && sink.count + TMQ_XML_OVERHEAD + strlen(payload) >= allowed) ? "PASS" : "FAIL");
+}
+
+void loop()
+{
+}
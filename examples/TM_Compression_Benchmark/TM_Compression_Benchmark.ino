@@ -0,0 +1,103 @@
+/*  TM_Compression_Benchmark.ino
+ *  Created: October 2026
+ *
+ *  Measures the compression ratio and throughput of the TMCompress codec on
+ *  representative housekeeping and spectrum TM payloads, and verifies that
+ *  every payload round-trips.
+ */
+
+#include <TMCompress.h>
+
+#define NUM_ITERATIONS 20
+
+uint8_t payload[8192];
+uint8_t packed[8192];
+uint8_t unpacked[8192];
+TMCompressState_t comp_state;
+
+uint16_t pseudoRandom()
+{
+  static uint32_t state = 12345;
+  state = state * 1103515245 + 12345;
+  return (state >> 16) & 0x7FFF;
+}
+
+// 16 channels of slowly varying 12-bit housekeeping with a little noise, big-endian
+uint16_t makeHousekeeping()
+{
+  uint16_t len = 0;
+  uint16_t channels[16];
+
+  for (int c = 0; c < 16; c++) {
+    channels[c] = 1000 + 150 * c;
+  }
+
+  while (len + 32 <= sizeof(payload)) {
+    for (int c = 0; c < 16; c++) {
+      channels[c] += (pseudoRandom() % 3) - 1;
+      payload[len++] = channels[c] >> 8;
+      payload[len++] = channels[c] & 0xFF;
+    }
+  }
+
+  return len;
+}
+
+// 4096-bin spectrum with a few peaks over a noisy baseline, big-endian
+uint16_t makeSpectrum()
+{
+  uint16_t len = 0;
+
+  for (int bin = 0; bin < 4096; bin++) {
+    uint16_t counts = 20 + (pseudoRandom() % 8);
+    if (bin % 512 > 250 && bin % 512 < 262) counts += 3000 - 200 * abs(bin % 512 - 256);
+    payload[len++] = counts >> 8;
+    payload[len++] = counts & 0xFF;
+  }
+
+  return len;
+}
+
+void runBenchmark(const char * name, uint16_t len)
+{
+  uint16_t packed_len = 0;
+  uint16_t unpacked_len = 0;
+  uint32_t start, comp_us, decomp_us;
+
+  start = micros();
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    packed_len = TMCompress(payload, len, packed, sizeof(packed), &comp_state);
+  }
+  comp_us = (micros() - start) / NUM_ITERATIONS;
+
+  start = micros();
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    unpacked_len = TMDecompress(packed, packed_len, unpacked, sizeof(unpacked));
+  }
+  decomp_us = (micros() - start) / NUM_ITERATIONS;
+
+  Serial.print(name); Serial.print(": "); Serial.print(len);
+  Serial.print(" -> "); Serial.print(packed_len);
+  Serial.print(" bytes, ratio "); Serial.println((float) len / packed_len);
+  Serial.print("  compress:   "); Serial.print(comp_us); Serial.print(" us, ");
+  Serial.print(len * 1000.0f / comp_us); Serial.println(" kB/s");
+  Serial.print("  decompress: "); Serial.print(decomp_us); Serial.print(" us, ");
+  Serial.print(len * 1000.0f / decomp_us); Serial.println(" kB/s");
+
+  if (0 == packed_len || unpacked_len != len || 0 != memcmp(payload, unpacked, len)) {
+    Serial.println("  ERROR: round trip failed");
+  }
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(3000);
+
+  runBenchmark("Housekeeping", makeHousekeeping());
+  runBenchmark("Spectrum", makeSpectrum());
+}
+
+void loop()
+{
+}
@@ -0,0 +1,76 @@
+/*  TM_Log_Benchmark.ino
+ *  Created: October 2026
+ *
+ *  Compares the CPU time and downlink bytes of sending log lines as
+ *  snprintf + TM_String against recording them with the deferred TMLog and
+ *  flushing them as one TM. Writes go to a counting sink, not the OBC.
+ */
+
+#include <XMLWriter_v5.h>
+#include <TMLog.h>
+
+#define BENCH_LOG_MESSAGES(X) \
+  X(LOG_TEMP, "temp ch%u = %.2f C") \
+  X(LOG_STATE, "state %s -> %s after %lu ms")
+
+TMLOG_DECLARE(BENCH_LOG_MESSAGES)
+
+#define NUM_LINES 50
+
+// counts the bytes that would go to the OBC
+class CountingSink : public Print {
+public:
+  size_t write(uint8_t) { count++; return 1; }
+  size_t write(const uint8_t * buffer, size_t size) { count += size; return size; }
+  uint32_t count = 0;
+};
+
+CountingSink sink;
+XMLWriter writer(&sink, LPC);
+TMLog zephyrLog;
+
+void report(const char * name, uint32_t elapsed_us, uint32_t bytes)
+{
+  Serial.print(name); Serial.print(": "); Serial.print(elapsed_us); Serial.print(" us, ");
+  Serial.print(bytes); Serial.print(" bytes ("); Serial.print((float) bytes / NUM_LINES);
+  Serial.println(" bytes/line)");
+}
+
+void setup()
+{
+  char line[101];
+  uint32_t start;
+
+  Serial.begin(115200);
+  delay(3000);
+
+  // formatted on the instrument, one TM per line
+  sink.count = 0;
+  start = micros();
+  for (int i = 0; i < NUM_LINES; i++) {
+    if (i % 2) {
+      snprintf(line, sizeof(line), "temp ch%u = %.2f C", i % 8, 20.0f + i / 4.0f);
+    } else {
+      snprintf(line, sizeof(line), "state %s -> %s after %lu ms", "idle", "measuring", (unsigned long) i * 1000);
+    }
+    writer.TM_String(FINE, line);
+  }
+  report("snprintf + TM_String", micros() - start, sink.count);
+
+  // deferred, one TM for all lines
+  sink.count = 0;
+  start = micros();
+  for (int i = 0; i < NUM_LINES; i++) {
+    if (i % 2) {
+      zephyrLog.log(LOG_TEMP, (uint8_t) (i % 8), 20.0f + i / 4.0f);
+    } else {
+      zephyrLog.log(LOG_STATE, "idle", "measuring", (unsigned long) i * 1000);
+    }
+  }
+  zephyrLog.flush(&writer);
+  report("TMLog + flush", micros() - start, sink.count);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,66 @@
+/*  XMLReader_Dispatch_Benchmark.ino
+ *  Created: October 2026
+ *
+ *  Compares the polymorphic XMLReader (virtual Stream calls) with the
+ *  statically dispatched XMLReaderT<MemoryStream> by parsing the same
+ *  captured OBC traffic from memory, and verifies both read it identically.
+ */
+
+#include <XMLReader_v5.h>
+#include <MemoryStream.h>
+
+#define NUM_ITERATIONS 200
+
+const char traffic[] =
+  "<IM>\n\t<Msg>12</Msg>\n\t<Inst>LPC</Inst>\n\t<Mode>FL</Mode>\n</IM>\n<CRC>1234</CRC>\n"
+  "<TMAck>\n\t<Msg>13</Msg>\n\t<Inst>LPC</Inst>\n\t<Ack>ACK</Ack>\n</TMAck>\n<CRC>1234</CRC>\n"
+  "<GPS>\n\t<Msg>14</Msg>\n\t<Date>2026/10/18</Date>\n\t<Time>12:34:56</Time>\n"
+  "\t<Lon>-105.2</Lon>\n\t<Lat>40.01</Lat>\n\t<Alt>20000.5</Alt>\n\t<SZA>45.5</SZA>\n"
+  "\t<VBAT>15.1</VBAT>\n\t<Diff>1.5</Diff>\n\t<Quality>3</Quality>\n</GPS>\n<CRC>1234</CRC>\n"
+  "<TC>\n\t<Msg>15</Msg>\n\t<Inst>LPC</Inst>\n\t<Length>6</Length>\n</TC>\n<CRC>1234</CRC>\n"
+  "START10,11;\x01\x02" "END";
+
+MemoryStream memory((const uint8_t *) traffic, sizeof(traffic) - 1);
+
+XMLReader virtualReader(&memory, LPC);
+XMLReaderT<MemoryStream> staticReader(&memory, LPC);
+
+// parse the traffic repeatedly, returning the time per pass and a checksum of the results
+template <class Reader>
+uint32_t runBenchmark(Reader & reader, uint32_t * checksum)
+{
+  uint32_t start = micros();
+
+  *checksum = 0;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    memory.reset((const uint8_t *) traffic, sizeof(traffic) - 1);
+    while (reader.GetNewMessage()) {
+      *checksum += reader.message_id + reader.zephyr_message + reader.zephyr_mode + reader.tc_length;
+    }
+  }
+
+  return (micros() - start) / NUM_ITERATIONS;
+}
+
+void setup()
+{
+  uint32_t virtual_us, static_us, virtual_sum, static_sum;
+
+  Serial.begin(115200);
+  delay(3000);
+
+  virtual_us = runBenchmark(virtualReader, &virtual_sum);
+  static_us = runBenchmark(staticReader, &static_sum);
+
+  Serial.print(sizeof(traffic) - 1); Serial.println(" bytes, 4 messages per pass");
+  Serial.print("  XMLReader:                "); Serial.print(virtual_us); Serial.println(" us");
+  Serial.print("  XMLReaderT<MemoryStream>: "); Serial.print(static_us); Serial.println(" us");
+
+  if (virtual_sum != static_sum) {
+    Serial.println("  ERROR: readers disagree");
+  }
+}
+
+void loop()
+{
+}
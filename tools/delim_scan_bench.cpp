@@ -0,0 +1,132 @@
+/*
+ * delim_scan_bench.cpp
+ * Created: October 2026
+ *
+ * Ground tool that benchmarks the delimiter scanner (see DelimScan.h) on
+ * capture files: every '<' is found with memchr and each scanner variant,
+ * then every '<', '>', ',' and ';'. Each variant must find the same number
+ * of delimiters, with the same sum of offsets. Build with -mavx2 (or
+ * -march=native) to include the AVX2 variant:
+ *
+ *     g++ -O2 -mavx2 -std=c++11 -I.. delim_scan_bench.cpp -o delim_scan_bench
+ *
+ * Usage: delim_scan_bench [-r repeats] capture [capture ...]
+ */
+
+#include "tm_archive.h"
+#include "DelimScan.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+
+typedef size_t (*ScanFunction_t)(const uint8_t * data, size_t length, const DelimSet_t & set);
+
+struct ScanResult {
+    uint64_t count = 0;
+    uint64_t offset_sum = 0;
+    double seconds = 0;
+};
+
+struct Variant {
+    const char * name;
+    ScanFunction_t scan;
+};
+
+static const Variant variants[] = {
+    {"scalar", DelimScanScalar},
+#if !defined(DELIMSCAN_SCALAR) && defined(__SSE2__)
+    {"SSE2", DelimScanSSE2},
+#endif
+#if !defined(DELIMSCAN_SCALAR) && defined(__AVX2__)
+    {"AVX2", DelimScanAVX2},
+#endif
+};
+
+// memchr for a single delimiter, as the decoder used before
+static size_t scanMemchr(const uint8_t * data, size_t length, const DelimSet_t & set)
+{
+    const uint8_t * found = (const uint8_t *) memchr(data, set.delims[0], length);
+    return (NULL == found) ? length : found - data;
+}
+
+static ScanResult scanAll(const TMArchiveMap & capture, ScanFunction_t scan, const DelimSet_t & set, int repeats)
+{
+    ScanResult result;
+
+    for (int r = 0; r < repeats; r++) {
+        uint64_t count = 0, offset_sum = 0;
+        size_t pos = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        while (pos < capture.size) {
+            pos += scan(capture.data + pos, capture.size - pos, set);
+            if (pos == capture.size) break;
+            count++;
+            offset_sum += pos++;
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        result.count = count;
+        result.offset_sum = offset_sum;
+        result.seconds += std::chrono::duration<double>(end - start).count();
+    }
+
+    return result;
+}
+
+static bool report(const char * name, const ScanResult & result, const ScanResult & reference, double mb, int repeats)
+{
+    bool same = result.count == reference.count && result.offset_sum == reference.offset_sum;
+
+    printf("    %-7s %10llu found, %8.1f MB/s (%.2fx scalar)%s\n", name, (unsigned long long) result.count,
+           mb * repeats / result.seconds, reference.seconds / result.seconds, same ? "" : "  MISMATCH");
+    return same;
+}
+
+int main(int argc, char ** argv)
+{
+    int repeats = 3;
+    int status = 0;
+    int arg = 1;
+
+    if (arg + 1 < argc && 0 == strcmp(argv[arg], "-r")) {
+        repeats = std::max(1, atoi(argv[arg + 1]));
+        arg += 2;
+    }
+
+    if (arg >= argc) {
+        fprintf(stderr, "usage: %s [-r repeats] capture [capture ...]\n", argv[0]);
+        return 2;
+    }
+
+    for (; arg < argc; arg++) {
+        TMArchiveMap capture;
+
+        if (!capture.open(argv[arg])) {
+            perror(argv[arg]);
+            status = 1;
+            continue;
+        }
+
+        double mb = capture.size / 1e6;
+        printf("%s: %.1f MB\n", argv[arg], mb);
+
+        static const char * const sets[] = {"<", "<>,;"};
+        for (const char * delims : sets) {
+            DelimSet_t set = DelimSet(delims, strlen(delims));
+            ScanResult reference = scanAll(capture, DelimScanScalar, set, repeats);
+
+            printf("  \"%s\"\n", delims);
+            if (1 == strlen(delims) && !report("memchr", scanAll(capture, scanMemchr, set, repeats), reference, mb, repeats)) {
+                status = 1;
+            }
+
+            for (const Variant & variant : variants) {
+                ScanResult result = (DelimScanScalar == variant.scan) ? reference : scanAll(capture, variant.scan, set, repeats);
+                if (!report(variant.name, result, reference, mb, repeats)) status = 1;
+            }
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,169 @@
+/*
+ * tm_archive.h
+ * Created: October 2026
+ *
+ * Shared pieces of the ground-side archive tools (Linux only): a read-only
+ * memory-mapped capture file, the CRC used by the XML messages and TM
+ * binary sections, and the payload record format written by
+ * tm_archive_decode.
+ *
+ * A decoded payload file holds one record per TM, big-endian:
+ *
+ *   [Msg (4)][GPS time (4)][capture offset of "<TM>" (8)][payload length (2)][payload]
+ *
+ * The GPS time is that of the latest valid GPS message before the TM in the
+ * capture, in seconds since 1970 (UTC), or 0 if there was none.
+ */
+
+#ifndef TM_ARCHIVE_H
+#define TM_ARCHIVE_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TMA_RECORD_HEADER_SIZE 18
+
+// longest XML section of a TM, from "<TM>" through "</TM>\n"
+#define TMA_XML_MAXSIZE 2048
+
+struct TMArchiveRecord {
+    uint32_t msg_id;
+    uint32_t gps_time;
+    uint64_t offset;
+    uint16_t length;
+    const uint8_t * payload;
+};
+
+// CRC-CCITT16 with the XMLWriter's initial value, table-driven
+class TMArchiveCrc {
+public:
+    TMArchiveCrc()
+    {
+        for (uint16_t i = 0; i < 256; i++) {
+            uint16_t crc = i << 8;
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+            table[i] = crc;
+        }
+    }
+
+    uint16_t block(const uint8_t * data, size_t length, uint16_t crc = 0x1021) const
+    {
+        for (size_t i = 0; i < length; i++) {
+            crc = (crc << 8) ^ table[(uint8_t) ((crc >> 8) ^ data[i])];
+        }
+        return crc;
+    }
+
+private:
+    uint16_t table[256];
+};
+
+// read-only mapping of a whole file
+class TMArchiveMap {
+public:
+    TMArchiveMap() { };
+    ~TMArchiveMap() { close(); }
+
+    bool open(const char * path)
+    {
+        struct stat info;
+        int fd;
+
+        close();
+
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+
+        if (0 != fstat(fd, &info)) {
+            ::close(fd);
+            return false;
+        }
+
+        size = info.st_size;
+        if (0 != size) {
+            void * mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED == mapped) {
+                ::close(fd);
+                size = 0;
+                return false;
+            }
+            data = (const uint8_t *) mapped;
+            // advice values aren't flags, so each takes its own call
+            madvise(mapped, size, MADV_SEQUENTIAL);
+            madvise(mapped, size, MADV_WILLNEED);
+        }
+
+        ::close(fd);
+        return true;
+    }
+
+    void close()
+    {
+        if (NULL != data) munmap((void *) data, size);
+        data = NULL;
+        size = 0;
+    }
+
+    const uint8_t * data = NULL;
+    size_t size = 0;
+};
+
+inline void tmaPut16(uint8_t * out, uint16_t value)
+{
+    out[0] = value >> 8;
+    out[1] = value & 0xFF;
+}
+
+inline void tmaPut32(uint8_t * out, uint32_t value)
+{
+    tmaPut16(out, value >> 16);
+    tmaPut16(out + 2, value & 0xFFFF);
+}
+
+inline void tmaPut64(uint8_t * out, uint64_t value)
+{
+    tmaPut32(out, value >> 32);
+    tmaPut32(out + 4, value & 0xFFFFFFFF);
+}
+
+inline uint16_t tmaGet16(const uint8_t * in)
+{
+    return ((uint16_t) in[0] << 8) | in[1];
+}
+
+inline uint32_t tmaGet32(const uint8_t * in)
+{
+    return ((uint32_t) tmaGet16(in) << 16) | tmaGet16(in + 2);
+}
+
+inline uint64_t tmaGet64(const uint8_t * in)
+{
+    return ((uint64_t) tmaGet32(in) << 32) | tmaGet32(in + 4);
+}
+
+// Reads the record at *pos of a mapped payload file and moves past it,
+// false at the end or if the record is truncated
+inline bool tmaNextRecord(const uint8_t * data, size_t size, size_t * pos, TMArchiveRecord * record)
+{
+    if (size - *pos < TMA_RECORD_HEADER_SIZE) return false;
+
+    const uint8_t * header = data + *pos;
+    record->msg_id = tmaGet32(header);
+    record->gps_time = tmaGet32(header + 4);
+    record->offset = tmaGet64(header + 8);
+    record->length = tmaGet16(header + 16);
+    if (size - *pos - TMA_RECORD_HEADER_SIZE < record->length) return false;
+
+    record->payload = header + TMA_RECORD_HEADER_SIZE;
+    *pos += TMA_RECORD_HEADER_SIZE + record->length;
+    return true;
+}
+
+#endif /* TM_ARCHIVE_H */
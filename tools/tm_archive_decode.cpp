@@ -0,0 +1,552 @@
+/*
+ * tm_archive_decode.cpp
+ * Created: October 2026
+ *
+ * Ground tool that decodes captured instrument-to-OBC serial transcripts in
+ * bulk. Each capture is memory-mapped and split into one chunk per thread;
+ * each thread decodes the TMs that start in its chunk, verifying the XML
+ * and binary CRCs. Chunk boundaries fall at arbitrary bytes, so a thread
+ * can start inside a binary section and mistake payload bytes for a "<TM>":
+ * when the chunks are stitched back together, messages inside the previous
+ * accepted message are discarded, and any bytes they may have hidden are
+ * decoded again serially.
+ *
+ * Each instrument's TM payloads are written to <outdir>/<Inst>.tmr in the
+ * record format described in tm_archive.h. Empty binary sections (e.g. from
+ * TM_String) are counted but not written. If the capture also holds the
+ * OBC's GPS messages (e.g. a tap on both directions), each record carries
+ * the time of the latest valid GPS message before it.
+ *
+ *     g++ -O2 -std=c++11 -pthread -I.. tm_archive_decode.cpp -o tm_archive_decode
+ *
+ * Usage: tm_archive_decode [-j threads] [-o outdir] capture [capture ...]
+ */
+
+#include "tm_archive.h"
+#include "DelimScan.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define INST_NAME_SIZE 16
+
+// longest GPS message, from "<GPS>" through "</GPS>\n"
+#define GPS_XML_MAXSIZE 1024
+
+struct DecodedTM {
+    uint64_t offset;  // of "<TM>" in the capture
+    uint64_t end;     // just past "END"
+    uint64_t payload; // offset of the binary payload
+    uint32_t msg_id;
+    uint32_t gps_time; // set once the chunks are stitched
+    uint16_t length;
+    char inst[INST_NAME_SIZE];
+};
+
+struct GPSFix {
+    uint64_t offset; // of "<GPS>" in the capture
+    uint32_t time;   // seconds since 1970
+};
+
+enum ParseResult_t {
+    PARSE_OK,
+    PARSE_MALFORMED, // not a complete TM, e.g. payload bytes that look like one
+    PARSE_XML_CRC,
+    PARSE_BIN_CRC    // valid XML, so the message is skipped whole
+};
+
+struct ChunkResult {
+    std::vector<DecodedTM> messages;
+    std::vector<uint64_t> xml_crc_errors; // offsets, filtered when stitching
+    std::vector<uint64_t> bin_crc_errors;
+    std::vector<GPSFix> gps; // filtered when stitching, like the errors
+};
+
+static const TMArchiveCrc crc;
+
+// --------------------------------------------------------
+// Parsing
+// --------------------------------------------------------
+
+static const DelimSet_t tag_open = DelimSet("<", 1);
+
+// A tag of an XML section, and where the text after it starts
+struct XMLNode {
+    const char * tag;
+    size_t tag_length;
+    const uint8_t * text; // NULL if the section doesn't have it
+};
+
+// One pass over the tags of the section opened by open_line at start, through
+// the first close_line within [start, limit): notes where the text of the
+// first of each node starts, and fails if the section is opened again first.
+// Returns the end of the section, or NULL.
+static const uint8_t * scanSection(const uint8_t * start, const uint8_t * limit, const char * open_line,
+                                   const char * close_line, XMLNode * nodes, size_t num_nodes)
+{
+    size_t open_length = strlen(open_line);
+    size_t close_length = strlen(close_line);
+    const uint8_t * pos = start + 1;
+
+    for (size_t i = 0; i < num_nodes; i++) {
+        nodes[i].text = NULL;
+    }
+
+    while (pos < limit) {
+        pos += DelimScan(pos, limit - pos, tag_open);
+        if (pos == limit) break;
+
+        size_t left = limit - pos;
+
+        if (left >= close_length && 0 == memcmp(pos, close_line, close_length)) return pos + close_length;
+        if (left >= open_length && 0 == memcmp(pos, open_line, open_length)) return NULL;
+
+        for (size_t i = 0; i < num_nodes; i++) {
+            if (NULL == nodes[i].text && left >= nodes[i].tag_length && 0 == memcmp(pos, nodes[i].tag, nodes[i].tag_length)) {
+                nodes[i].text = pos + nodes[i].tag_length;
+                break;
+            }
+        }
+
+        pos++;
+    }
+
+    return NULL;
+}
+
+// digits at pos, closed by a '<' before end
+static bool parseNumber(const uint8_t * pos, const uint8_t * end, uint64_t * value)
+{
+    bool any = false;
+
+    if (NULL == pos) return false;
+
+    *value = 0;
+    for (; pos < end && *pos >= '0' && *pos <= '9'; pos++) {
+        *value = *value * 10 + (*pos - '0');
+        if (*value > 0xFFFFFFFF) return false;
+        any = true;
+    }
+
+    return any && pos < end && '<' == *pos;
+}
+
+// copies the text at pos, closed by a '<' before end
+static bool nodeText(const uint8_t * pos, const uint8_t * end, char * text, size_t text_size)
+{
+    size_t length;
+
+    if (NULL == pos) return false;
+
+    length = DelimScan(pos, end - pos, tag_open);
+    if (pos + length == end || length >= text_size) return false;
+
+    memcpy(text, pos, length);
+    text[length] = '\0';
+    return true;
+}
+
+static bool parseInst(const uint8_t * pos, const uint8_t * end, char * inst)
+{
+    if (!nodeText(pos, end, inst, INST_NAME_SIZE) || '\0' == inst[0]) return false;
+
+    for (const char * c = inst; '\0' != *c; c++) {
+        if (!((*c >= 'A' && *c <= 'Z') || (*c >= 'a' && *c <= 'z') || (*c >= '0' && *c <= '9') || '_' == *c)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static ParseResult_t parseTM(const uint8_t * data, size_t size, uint64_t offset, DecodedTM * tm)
+{
+    const uint8_t * start = data + offset;
+    const uint8_t * limit = data + size;
+    const uint8_t * xml_end;
+    const uint8_t * pos;
+    uint64_t msg_id, length, xml_crc;
+    XMLNode nodes[3] = {{"<Msg>", 5, NULL}, {"<Inst>", 6, NULL}, {"<Length>", 8, NULL}};
+
+    // the XML section, through "</TM>\n"
+    xml_end = scanSection(start, std::min(limit, start + TMA_XML_MAXSIZE), "<TM>\n", "</TM>\n", nodes, 3);
+    if (NULL == xml_end) return PARSE_MALFORMED;
+
+    if (!parseNumber(nodes[0].text, xml_end, &msg_id) || !parseInst(nodes[1].text, xml_end, tm->inst) ||
+        !parseNumber(nodes[2].text, xml_end, &length) || length > 0xFFFF) {
+        return PARSE_MALFORMED;
+    }
+
+    // "<CRC>digits</CRC>\n" follows directly
+    pos = xml_end;
+    if (limit - pos < 5 || 0 != memcmp(pos, "<CRC>", 5)) return PARSE_MALFORMED;
+    if (!parseNumber(pos + 5, std::min(limit, pos + 16), &xml_crc)) return PARSE_MALFORMED;
+    pos += 5 + DelimScan(pos + 5, std::min(limit, pos + 18) - (pos + 5), tag_open);
+    if (limit - pos < 7 || 0 != memcmp(pos, "</CRC>\n", 7)) return PARSE_MALFORMED;
+    pos += 7;
+
+    if (crc.block(start, xml_end - start) != xml_crc) return PARSE_XML_CRC;
+
+    // "START", the payload, its crc and "END"
+    if ((uint64_t) (limit - pos) < 5 + length + 5 || 0 != memcmp(pos, "START", 5) ||
+        0 != memcmp(pos + 5 + length + 2, "END", 3)) {
+        return PARSE_MALFORMED;
+    }
+
+    tm->offset = offset;
+    tm->payload = pos + 5 - data;
+    tm->end = tm->payload + length + 5;
+    tm->msg_id = msg_id;
+    tm->gps_time = 0;
+    tm->length = length;
+
+    if (crc.block(pos + 5, length) != tmaGet16(pos + 5 + length)) return PARSE_BIN_CRC;
+
+    return PARSE_OK;
+}
+
+// days since 1970-01-01 of a proleptic Gregorian date
+static int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned year_of_era = (unsigned) (year - era * 400);
+    unsigned day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + (int64_t) day_of_era - 719468;
+}
+
+// a GPS message with a valid date, time and fix, checked as XMLReader does
+static bool parseGPS(const uint8_t * data, size_t size, uint64_t offset, GPSFix * fix)
+{
+    const uint8_t * start = data + offset;
+    const uint8_t * xml_end;
+    unsigned year, month, day, hour, minute, second, quality;
+    char text[16];
+    XMLNode nodes[3] = {{"<Date>", 6, NULL}, {"<Time>", 6, NULL}, {"<Quality>", 9, NULL}};
+
+    xml_end = scanSection(start, data + std::min((uint64_t) size, offset + GPS_XML_MAXSIZE), "<GPS>\n", "</GPS>\n",
+                          nodes, 3);
+    if (NULL == xml_end) return false;
+
+    if (!nodeText(nodes[0].text, xml_end, text, sizeof(text)) ||
+        3 != sscanf(text, "%u/%u/%u", &year, &month, &day) ||
+        year < 1970 || year > 2050 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+
+    if (!nodeText(nodes[1].text, xml_end, text, sizeof(text)) ||
+        3 != sscanf(text, "%u:%u:%u", &hour, &minute, &second) ||
+        hour > 23 || minute > 59 || second > 59) {
+        return false;
+    }
+
+    if (!nodeText(nodes[2].text, xml_end, text, sizeof(text)) ||
+        1 != sscanf(text, "%u", &quality) || 0 == quality) {
+        return false;
+    }
+
+    fix->offset = offset;
+    fix->time = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+// decodes the TMs that start in [begin, stop), the last may run past stop,
+// and notes the GPS messages between them
+static void decodeRange(const uint8_t * data, size_t size, uint64_t begin, uint64_t stop, ChunkResult * result)
+{
+    uint64_t pos = begin;
+    DecodedTM tm;
+    GPSFix fix;
+
+    while (pos < stop) {
+        pos += DelimScan(data + pos, stop - pos, tag_open);
+        if (pos == stop) break;
+
+        const uint8_t * found = data + pos;
+
+        if (size - pos >= 6 && 0 == memcmp(found, "<GPS>\n", 6)) {
+            if (parseGPS(data, size, pos, &fix)) result->gps.push_back(fix);
+            pos++;
+            continue;
+        }
+
+        if (size - pos < 5 || 0 != memcmp(found, "<TM>\n", 5)) {
+            pos++;
+            continue;
+        }
+
+        switch (parseTM(data, size, pos, &tm)) {
+        case PARSE_OK:
+            result->messages.push_back(tm);
+            pos = tm.end;
+            break;
+        case PARSE_BIN_CRC:
+            result->bin_crc_errors.push_back(pos);
+            pos = tm.end;
+            break;
+        case PARSE_XML_CRC:
+            result->xml_crc_errors.push_back(pos);
+            pos++;
+            break;
+        default:
+            pos++;
+            break;
+        }
+    }
+}
+
+// --------------------------------------------------------
+// Stitching chunks
+// --------------------------------------------------------
+
+struct Decoded {
+    std::vector<DecodedTM> messages;
+    uint64_t xml_crc_errors = 0;
+    uint64_t bin_crc_errors = 0;
+    uint64_t resyncs = 0;
+};
+
+// With offsets visited in increasing order, whether an offset is inside one
+// of the accepted messages (i.e. it was payload bytes)
+static bool insideMessage(uint64_t offset, const std::vector<DecodedTM> & messages, size_t * next)
+{
+    while (*next < messages.size() && messages[*next].end <= offset) (*next)++;
+    return *next < messages.size() && offset >= messages[*next].offset;
+}
+
+static uint64_t countErrors(std::vector<uint64_t> & offsets, const std::vector<DecodedTM> & messages)
+{
+    uint64_t count = 0;
+    size_t next = 0;
+
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+
+    for (uint64_t offset : offsets) {
+        if (!insideMessage(offset, messages, &next)) count++;
+    }
+
+    return count;
+}
+
+// stamps each message with the latest GPS time before it
+static void stampTimes(std::vector<GPSFix> & fixes, std::vector<DecodedTM> & messages)
+{
+    size_t next = 0;
+    size_t fix = 0;
+    uint32_t time = 0;
+
+    std::sort(fixes.begin(), fixes.end(), [](const GPSFix & a, const GPSFix & b) { return a.offset < b.offset; });
+
+    for (DecodedTM & tm : messages) {
+        for (; fix < fixes.size() && fixes[fix].offset < tm.offset; fix++) {
+            if (!insideMessage(fixes[fix].offset, messages, &next)) time = fixes[fix].time;
+        }
+        tm.gps_time = time;
+    }
+}
+
+static void appendResults(ChunkResult * results, const ChunkResult & result)
+{
+    results->xml_crc_errors.insert(results->xml_crc_errors.end(), result.xml_crc_errors.begin(), result.xml_crc_errors.end());
+    results->bin_crc_errors.insert(results->bin_crc_errors.end(), result.bin_crc_errors.begin(), result.bin_crc_errors.end());
+    results->gps.insert(results->gps.end(), result.gps.begin(), result.gps.end());
+}
+
+// decodes [*pos, stop) serially after a chunk lost sync, advancing *pos
+static void resyncRange(const uint8_t * data, size_t size, uint64_t * pos, uint64_t stop,
+                        Decoded * decoded, ChunkResult * results)
+{
+    ChunkResult serial;
+
+    decodeRange(data, size, *pos, stop, &serial);
+    decoded->resyncs++;
+
+    for (const DecodedTM & tm : serial.messages) {
+        decoded->messages.push_back(tm);
+        *pos = tm.end;
+    }
+    appendResults(results, serial);
+}
+
+static void stitch(const uint8_t * data, size_t size, const std::vector<ChunkResult> & chunks,
+                   const std::vector<uint64_t> & bounds, Decoded * decoded)
+{
+    ChunkResult results;
+    uint64_t pos = 0;
+
+    for (size_t k = 0; k < chunks.size(); k++) {
+        bool resync = false;
+
+        for (const DecodedTM & tm : chunks[k].messages) {
+            if (resync && tm.offset > pos) {
+                resyncRange(data, size, &pos, tm.offset, decoded, &results);
+            }
+
+            // found by scanning inside an accepted message: if it runs past
+            // that message it may have hidden real ones
+            if (tm.offset < pos) {
+                if (tm.end > pos) resync = true;
+                continue;
+            }
+
+            decoded->messages.push_back(tm);
+            pos = tm.end;
+            resync = false;
+        }
+
+        if (resync && pos < bounds[k + 1]) {
+            resyncRange(data, size, &pos, bounds[k + 1], decoded, &results);
+        }
+
+        appendResults(&results, chunks[k]);
+    }
+
+    decoded->xml_crc_errors = countErrors(results.xml_crc_errors, decoded->messages);
+    decoded->bin_crc_errors = countErrors(results.bin_crc_errors, decoded->messages);
+    stampTimes(results.gps, decoded->messages);
+}
+
+// --------------------------------------------------------
+// Output
+// --------------------------------------------------------
+
+struct InstOutput {
+    FILE * file = NULL;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+};
+
+static bool writePayloads(const uint8_t * data, const std::vector<DecodedTM> & messages, const std::string & outdir,
+                          std::map<std::string, InstOutput> & outputs, uint64_t * empty)
+{
+    uint8_t header[TMA_RECORD_HEADER_SIZE];
+
+    for (const DecodedTM & tm : messages) {
+        if (0 == tm.length) {
+            (*empty)++;
+            continue;
+        }
+
+        InstOutput & out = outputs[tm.inst];
+        if (NULL == out.file) {
+            std::string path = outdir + "/" + tm.inst + ".tmr";
+            out.file = fopen(path.c_str(), "wb");
+            if (NULL == out.file) {
+                perror(path.c_str());
+                return false;
+            }
+            setvbuf(out.file, NULL, _IOFBF, 1 << 20);
+        }
+
+        tmaPut32(header, tm.msg_id);
+        tmaPut32(header + 4, tm.gps_time);
+        tmaPut64(header + 8, tm.offset);
+        tmaPut16(header + 16, tm.length);
+        if (1 != fwrite(header, TMA_RECORD_HEADER_SIZE, 1, out.file) ||
+            1 != fwrite(data + tm.payload, tm.length, 1, out.file)) {
+            perror(tm.inst);
+            return false;
+        }
+
+        out.messages++;
+        out.bytes += tm.length;
+    }
+
+    return true;
+}
+
+// --------------------------------------------------------
+// Main
+// --------------------------------------------------------
+
+int main(int argc, char ** argv)
+{
+    unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string outdir = ".";
+    std::map<std::string, InstOutput> outputs;
+    int status = 0;
+    int arg = 1;
+
+    for (; arg < argc && '-' == argv[arg][0]; arg++) {
+        if (0 == strcmp(argv[arg], "-j") && arg + 1 < argc) {
+            num_threads = std::max(1, atoi(argv[++arg]));
+        } else if (0 == strcmp(argv[arg], "-o") && arg + 1 < argc) {
+            outdir = argv[++arg];
+        } else {
+            break;
+        }
+    }
+
+    if (arg >= argc) {
+        fprintf(stderr, "usage: %s [-j threads] [-o outdir] capture [capture ...]\n", argv[0]);
+        return 2;
+    }
+
+    for (; arg < argc; arg++) {
+        TMArchiveMap capture;
+        std::vector<ChunkResult> chunks;
+        std::vector<uint64_t> bounds;
+        std::vector<std::thread> threads;
+        Decoded decoded;
+        uint64_t empty = 0;
+
+        if (!capture.open(argv[arg])) {
+            perror(argv[arg]);
+            status = 1;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        // one chunk per thread, at least 1 MB each
+        size_t num_chunks = std::max((size_t) 1, std::min((size_t) num_threads, capture.size >> 20));
+        chunks.resize(num_chunks);
+        for (size_t k = 0; k <= num_chunks; k++) {
+            bounds.push_back(capture.size * k / num_chunks);
+        }
+
+        for (size_t k = 0; k < num_chunks; k++) {
+            threads.emplace_back(decodeRange, capture.data, capture.size, bounds[k], bounds[k + 1], &chunks[k]);
+        }
+        for (std::thread & thread : threads) {
+            thread.join();
+        }
+
+        stitch(capture.data, capture.size, chunks, bounds, &decoded);
+
+        auto decoded_at = std::chrono::steady_clock::now();
+
+        if (!writePayloads(capture.data, decoded.messages, outdir, outputs, &empty)) {
+            status = 1;
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        double decode_s = std::chrono::duration<double>(decoded_at - start).count();
+        double total_s = std::chrono::duration<double>(end - start).count();
+        double mb = capture.size / 1e6;
+
+        printf("%s: %.1f MB, %zu TMs (%llu empty), %llu XML CRC errors, %llu binary CRC errors, %llu resyncs\n",
+               argv[arg], mb, decoded.messages.size(), (unsigned long long) empty,
+               (unsigned long long) decoded.xml_crc_errors, (unsigned long long) decoded.bin_crc_errors,
+               (unsigned long long) decoded.resyncs);
+        printf("  %zu threads: decode %.3f s (%.0f MB/s), with output %.3f s (%.0f MB/s)\n",
+               num_chunks, decode_s, mb / decode_s, total_s, mb / total_s);
+    }
+
+    for (auto & entry : outputs) {
+        printf("%s: %llu payloads, %llu bytes\n", entry.first.c_str(),
+               (unsigned long long) entry.second.messages, (unsigned long long) entry.second.bytes);
+        if (NULL != entry.second.file && 0 != fclose(entry.second.file)) {
+            perror(entry.first.c_str());
+            status = 1;
+        }
+    }
+
+    return status;
+}
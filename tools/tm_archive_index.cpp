@@ -0,0 +1,305 @@
+/*
+ * tm_archive_index.cpp
+ * Created: October 2026
+ *
+ * Ground tool that builds and queries the indexed columnar archive (see
+ * tm_columnar.h) of an instrument's decoded payloads, and benchmarks range
+ * queries against a linear scan of the decoded record file.
+ *
+ *     g++ -O2 -std=c++11 tm_archive_index.cpp -o tm_archive_index
+ *
+ * Usage:
+ *   tm_archive_index build LPC.tmr LPC.tmc [records per segment]
+ *   tm_archive_index query LPC.tmc [-m first:last] [-t start:end] [-o out.tmr]
+ *   tm_archive_index bench LPC.tmr LPC.tmc [queries]
+ *
+ * Msg id and time ranges are inclusive; times are GPS seconds since 1970.
+ * Query output is written in the record format of tm_archive.h.
+ */
+
+#include "tm_columnar.h"
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+
+struct Query {
+    uint32_t msg_min = 0;
+    uint32_t msg_max = 0xFFFFFFFF;
+    uint32_t time_min = 0;
+    uint32_t time_max = 0xFFFFFFFF;
+
+    bool matches(uint32_t msg_id, uint32_t gps_time) const
+    {
+        return msg_id >= msg_min && msg_id <= msg_max && gps_time >= time_min && gps_time <= time_max;
+    }
+
+    bool overlaps(const TMColumnarIndex_t & entry) const
+    {
+        return entry.msg_max >= msg_min && entry.msg_min <= msg_max &&
+               entry.time_max >= time_min && entry.time_min <= time_max;
+    }
+};
+
+struct QueryResult {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    uint64_t checksum = 0;
+    uint64_t segments = 0; // touched
+};
+
+// every query path reads each matching payload once
+static void visit(const TMArchiveRecord & record, QueryResult * result, FILE * out)
+{
+    uint64_t sum = 0;
+
+    for (uint16_t i = 0; i < record.length; i++) sum += record.payload[i];
+
+    result->records++;
+    result->bytes += record.length;
+    result->checksum += sum ^ ((uint64_t) record.msg_id << 32);
+
+    if (NULL != out) {
+        uint8_t header[TMA_RECORD_HEADER_SIZE];
+        tmaPut32(header, record.msg_id);
+        tmaPut32(header + 4, record.gps_time);
+        tmaPut64(header + 8, record.offset);
+        tmaPut16(header + 16, record.length);
+        fwrite(header, TMA_RECORD_HEADER_SIZE, 1, out);
+        fwrite(record.payload, record.length, 1, out);
+    }
+}
+
+static QueryResult queryColumnar(const TMColumnarReader & archive, const Query & query, FILE * out)
+{
+    QueryResult result;
+    TMArchiveRecord record;
+
+    for (uint32_t k = 0; k < archive.num_segments; k++) {
+        if (!query.overlaps(archive.index[k])) continue;
+
+        TMColumnarSegment segment = archive.segment(k);
+        result.segments++;
+
+        for (uint32_t i = 0; i < segment.entry->count; i++) {
+            if (!query.matches(segment.msg_ids[i], segment.gps_times[i])) continue;
+            segment.record(i, &record);
+            visit(record, &result, out);
+        }
+    }
+
+    return result;
+}
+
+static QueryResult queryLinear(const TMArchiveMap & records, const Query & query)
+{
+    QueryResult result;
+    TMArchiveRecord record;
+    size_t pos = 0;
+
+    while (tmaNextRecord(records.data, records.size, &pos, &record)) {
+        if (query.matches(record.msg_id, record.gps_time)) visit(record, &result, NULL);
+    }
+
+    return result;
+}
+
+// --------------------------------------------------------
+// Commands
+// --------------------------------------------------------
+
+static int build(const char * in_path, const char * out_path, uint32_t records_per_segment)
+{
+    TMArchiveMap records;
+    TMColumnarWriter writer;
+    TMArchiveRecord record;
+    size_t pos = 0;
+    uint64_t count = 0;
+
+    if (!records.open(in_path)) {
+        perror(in_path);
+        return 1;
+    }
+
+    if (!writer.open(out_path, records_per_segment)) {
+        perror(out_path);
+        return 1;
+    }
+
+    while (tmaNextRecord(records.data, records.size, &pos, &record)) {
+        if (!writer.add(record)) {
+            perror(out_path);
+            return 1;
+        }
+        count++;
+    }
+
+    if (pos != records.size) {
+        fprintf(stderr, "%s: truncated record at %zu, ignored\n", in_path, pos);
+    }
+
+    if (!writer.close()) {
+        perror(out_path);
+        return 1;
+    }
+
+    printf("%s: %llu records\n", out_path, (unsigned long long) count);
+    return 0;
+}
+
+static bool parseRange(const char * text, uint32_t * first, uint32_t * last)
+{
+    unsigned long a, b;
+
+    if (2 != sscanf(text, "%lu:%lu", &a, &b) || a > b || b > 0xFFFFFFFF) return false;
+
+    *first = a;
+    *last = b;
+    return true;
+}
+
+static int query(int argc, char ** argv)
+{
+    TMColumnarReader archive;
+    Query range;
+    FILE * out = NULL;
+    const char * out_path = NULL;
+
+    for (int arg = 3; arg < argc; arg++) {
+        if (0 == strcmp(argv[arg], "-m") && arg + 1 < argc && parseRange(argv[arg + 1], &range.msg_min, &range.msg_max)) {
+            arg++;
+        } else if (0 == strcmp(argv[arg], "-t") && arg + 1 < argc && parseRange(argv[arg + 1], &range.time_min, &range.time_max)) {
+            arg++;
+        } else if (0 == strcmp(argv[arg], "-o") && arg + 1 < argc) {
+            out_path = argv[++arg];
+        } else {
+            fprintf(stderr, "bad query argument: %s\n", argv[arg]);
+            return 2;
+        }
+    }
+
+    if (!archive.open(argv[2])) {
+        fprintf(stderr, "%s: not a columnar archive\n", argv[2]);
+        return 1;
+    }
+
+    if (NULL != out_path) {
+        out = fopen(out_path, "wb");
+        if (NULL == out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    QueryResult result = queryColumnar(archive, range, out);
+
+    if (NULL != out && 0 != fclose(out)) {
+        perror(out_path);
+        return 1;
+    }
+
+    printf("%llu records, %llu bytes, %llu of %u segments read\n", (unsigned long long) result.records,
+           (unsigned long long) result.bytes, (unsigned long long) result.segments, archive.num_segments);
+    return 0;
+}
+
+// random Msg id and time windows of a few widths, each run both ways
+static int bench(const char * records_path, const char * archive_path, int num_queries)
+{
+    static const double widths[] = {0.001, 0.01, 0.1};
+    TMArchiveMap records;
+    TMColumnarReader archive;
+    std::mt19937 rng(1);
+    uint32_t msg_lo = 0xFFFFFFFF, msg_hi = 0, time_lo = 0xFFFFFFFF, time_hi = 0;
+    int status = 0;
+
+    if (!records.open(records_path)) {
+        perror(records_path);
+        return 1;
+    }
+
+    if (!archive.open(archive_path) || 0 == archive.num_segments) {
+        fprintf(stderr, "%s: not a columnar archive, or empty\n", archive_path);
+        return 1;
+    }
+
+    for (uint32_t k = 0; k < archive.num_segments; k++) {
+        msg_lo = std::min(msg_lo, archive.index[k].msg_min);
+        msg_hi = std::max(msg_hi, archive.index[k].msg_max);
+        time_hi = std::max(time_hi, archive.index[k].time_max);
+
+        // records before the first GPS message have time 0
+        uint32_t first_time = (0 != archive.index[k].time_min) ? archive.index[k].time_min : archive.index[k].time_max;
+        if (0 != first_time) time_lo = std::min(time_lo, first_time);
+    }
+
+    if (time_lo > time_hi) time_lo = time_hi;
+
+    printf("%llu records in %u segments, %.1f MB of records\n", (unsigned long long) archive.num_records,
+           archive.num_segments, records.size / 1e6);
+
+    for (int by_time = 0; by_time < 2; by_time++) {
+        for (double width : widths) {
+            double linear_s = 0, columnar_s = 0;
+            uint64_t matched = 0, segments = 0;
+
+            for (int q = 0; q < num_queries; q++) {
+                Query range;
+                uint32_t lo = by_time ? time_lo : msg_lo;
+                uint32_t span = (by_time ? time_hi : msg_hi) - lo;
+                uint32_t window = std::max(1.0, span * width);
+                uint32_t first = lo + rng() % std::max(1u, span - window + 1);
+
+                if (by_time) {
+                    range.time_min = first;
+                    range.time_max = first + window - 1;
+                } else {
+                    range.msg_min = first;
+                    range.msg_max = first + window - 1;
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                QueryResult linear = queryLinear(records, range);
+                auto middle = std::chrono::steady_clock::now();
+                QueryResult columnar = queryColumnar(archive, range, NULL);
+                auto end = std::chrono::steady_clock::now();
+
+                linear_s += std::chrono::duration<double>(middle - start).count();
+                columnar_s += std::chrono::duration<double>(end - middle).count();
+                matched += columnar.records;
+                segments += columnar.segments;
+
+                if (linear.records != columnar.records || linear.checksum != columnar.checksum) {
+                    fprintf(stderr, "results differ for %s %u-%u\n", by_time ? "time" : "Msg", first, first + window - 1);
+                    status = 1;
+                }
+            }
+
+            printf("%-4s window %5.1f%%: %8.1f records/query, linear %8.3f ms, indexed %8.3f ms (%.0fx), %.1f segments read\n",
+                   by_time ? "time" : "Msg", width * 100, (double) matched / num_queries,
+                   1e3 * linear_s / num_queries, 1e3 * columnar_s / num_queries, linear_s / columnar_s,
+                   (double) segments / num_queries);
+        }
+    }
+
+    return status;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc >= 4 && 0 == strcmp(argv[1], "build")) {
+        return build(argv[2], argv[3], argc >= 5 ? std::max(1, atoi(argv[4])) : TMC_SEGMENT_RECORDS);
+    }
+
+    if (argc >= 3 && 0 == strcmp(argv[1], "query")) {
+        return query(argc, argv);
+    }
+
+    if (argc >= 4 && 0 == strcmp(argv[1], "bench")) {
+        return bench(argv[2], argv[3], argc >= 5 ? std::max(1, atoi(argv[4])) : 20);
+    }
+
+    fprintf(stderr, "usage: %s build records.tmr archive.tmc [records per segment]\n"
+                    "       %s query archive.tmc [-m first:last] [-t start:end] [-o out.tmr]\n"
+                    "       %s bench records.tmr archive.tmc [queries]\n", argv[0], argv[0], argv[0]);
+    return 2;
+}
@@ -0,0 +1,260 @@
+/*
+ * tm_columnar.h
+ * Created: October 2026
+ *
+ * Columnar archive of one instrument's decoded TM payloads (Linux only),
+ * built from the record files written by tm_archive_decode. Records are
+ * kept in capture order, in segments of up to a fixed number of records.
+ * Each segment stores each field as its own column, and a sparse index
+ * holds each segment's Msg id and GPS time ranges. A query by Msg id or
+ * time range checks the index first, then reads only the id and time
+ * columns of the segments that can match, and only the payloads that do.
+ *
+ * File layout, all integers little-endian:
+ *
+ *   header (32 bytes): "TMCA", version (4), segment count (4),
+ *                      record count (8), index offset (8), reserved (4)
+ *   segments, each starting 8-byte aligned
+ *   index: one TMColumnarIndex_t (32 bytes) per segment
+ *
+ * A segment of n records holds its columns back to back, each 8-byte
+ * aligned: Msg ids (4 n), GPS times (4 n), capture offsets (8 n), payload
+ * ends (4 n, cumulative within the segment's payload column), payloads.
+ */
+
+#ifndef TM_COLUMNAR_H
+#define TM_COLUMNAR_H
+
+#include "tm_archive.h"
+#include <vector>
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the columnar archive is read in place, on little-endian hosts only"
+#endif
+
+#define TMC_ARCHIVE_VERSION     1
+#define TMC_HEADER_SIZE         32
+#define TMC_SEGMENT_RECORDS     1024 // default records per segment
+
+struct TMColumnarIndex_t {
+    uint64_t offset; // of the segment in the file
+    uint32_t count;  // records
+    uint32_t payload_bytes;
+    uint32_t msg_min;
+    uint32_t msg_max;
+    uint32_t time_min;
+    uint32_t time_max;
+};
+
+static_assert(sizeof(TMColumnarIndex_t) == 32, "index entries are packed");
+
+inline size_t tmcAlign(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+// columns of a segment, pointing into the mapped file
+struct TMColumnarSegment {
+    const TMColumnarIndex_t * entry;
+    const uint32_t * msg_ids;
+    const uint32_t * gps_times;
+    const uint64_t * offsets;
+    const uint32_t * payload_ends;
+    const uint8_t * payloads;
+
+    void record(uint32_t i, TMArchiveRecord * record) const
+    {
+        uint32_t start = (0 == i) ? 0 : payload_ends[i - 1];
+
+        record->msg_id = msg_ids[i];
+        record->gps_time = gps_times[i];
+        record->offset = offsets[i];
+        record->length = payload_ends[i] - start;
+        record->payload = payloads + start;
+    }
+};
+
+// --------------------------------------------------------
+// Writer
+// --------------------------------------------------------
+
+class TMColumnarWriter {
+public:
+    TMColumnarWriter() { };
+    ~TMColumnarWriter() { close(); }
+
+    bool open(const char * path, uint32_t records_per_segment = TMC_SEGMENT_RECORDS)
+    {
+        uint8_t header[TMC_HEADER_SIZE] = {0};
+
+        close();
+
+        file = fopen(path, "wb");
+        if (NULL == file) return false;
+
+        segment_records = records_per_segment;
+        file_offset = TMC_HEADER_SIZE;
+        num_records = 0;
+        index.clear();
+        return 1 == fwrite(header, TMC_HEADER_SIZE, 1, file);
+    }
+
+    bool add(const TMArchiveRecord & record)
+    {
+        // a segment's payload column must stay addressable by 32-bit ends
+        if (!msg_ids.empty() && payloads.size() + record.length > 0xFFFFFFFF && !flush()) return false;
+
+        msg_ids.push_back(record.msg_id);
+        gps_times.push_back(record.gps_time);
+        offsets.push_back(record.offset);
+        payloads.insert(payloads.end(), record.payload, record.payload + record.length);
+        payload_ends.push_back(payloads.size());
+        num_records++;
+
+        return msg_ids.size() < segment_records || flush();
+    }
+
+    // writes the last segment, the index and the header
+    bool close()
+    {
+        uint8_t header[TMC_HEADER_SIZE] = {'T', 'M', 'C', 'A'};
+        uint32_t version = TMC_ARCHIVE_VERSION;
+        uint32_t num_segments;
+        bool ok;
+
+        if (NULL == file) return true;
+
+        ok = flush();
+        num_segments = index.size();
+        memcpy(header + 4, &version, 4);
+        memcpy(header + 8, &num_segments, 4);
+        memcpy(header + 12, &num_records, 8);
+        memcpy(header + 20, &file_offset, 8);
+
+        ok = ok && (index.empty() || 1 == fwrite(index.data(), index.size() * sizeof(TMColumnarIndex_t), 1, file));
+        ok = ok && 0 == fseek(file, 0, SEEK_SET) && 1 == fwrite(header, TMC_HEADER_SIZE, 1, file);
+        ok = (0 == fclose(file)) && ok;
+        file = NULL;
+        return ok;
+    }
+
+private:
+    bool writeColumn(const void * data, size_t size)
+    {
+        static const uint8_t padding[8] = {0};
+        size_t padded = tmcAlign(size);
+
+        if (0 != size && 1 != fwrite(data, size, 1, file)) return false;
+        if (padded != size && 1 != fwrite(padding, padded - size, 1, file)) return false;
+
+        file_offset += padded;
+        return true;
+    }
+
+    bool flush()
+    {
+        TMColumnarIndex_t entry;
+
+        if (msg_ids.empty()) return true;
+
+        entry.offset = file_offset;
+        entry.count = msg_ids.size();
+        entry.payload_bytes = payloads.size();
+        entry.msg_min = entry.time_min = 0xFFFFFFFF;
+        entry.msg_max = entry.time_max = 0;
+        for (uint32_t i = 0; i < entry.count; i++) {
+            if (msg_ids[i] < entry.msg_min) entry.msg_min = msg_ids[i];
+            if (msg_ids[i] > entry.msg_max) entry.msg_max = msg_ids[i];
+            if (gps_times[i] < entry.time_min) entry.time_min = gps_times[i];
+            if (gps_times[i] > entry.time_max) entry.time_max = gps_times[i];
+        }
+
+        if (!writeColumn(msg_ids.data(), 4 * entry.count) || !writeColumn(gps_times.data(), 4 * entry.count) ||
+            !writeColumn(offsets.data(), 8 * entry.count) || !writeColumn(payload_ends.data(), 4 * entry.count) ||
+            !writeColumn(payloads.data(), payloads.size())) {
+            return false;
+        }
+
+        index.push_back(entry);
+        msg_ids.clear();
+        gps_times.clear();
+        offsets.clear();
+        payload_ends.clear();
+        payloads.clear();
+        return true;
+    }
+
+    FILE * file = NULL;
+    uint32_t segment_records = TMC_SEGMENT_RECORDS;
+    uint64_t file_offset = 0;
+    uint64_t num_records = 0;
+    std::vector<TMColumnarIndex_t> index;
+
+    // the segment being built
+    std::vector<uint32_t> msg_ids;
+    std::vector<uint32_t> gps_times;
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> payload_ends;
+    std::vector<uint8_t> payloads;
+};
+
+// --------------------------------------------------------
+// Reader
+// --------------------------------------------------------
+
+class TMColumnarReader {
+public:
+    bool open(const char * path)
+    {
+        uint32_t version;
+        uint64_t index_offset;
+
+        if (!map.open(path) || map.size < TMC_HEADER_SIZE || 0 != memcmp(map.data, "TMCA", 4)) return false;
+
+        memcpy(&version, map.data + 4, 4);
+        memcpy(&num_segments, map.data + 8, 4);
+        memcpy(&num_records, map.data + 12, 8);
+        memcpy(&index_offset, map.data + 20, 8);
+
+        if (TMC_ARCHIVE_VERSION != version || index_offset > map.size ||
+            (map.size - index_offset) / sizeof(TMColumnarIndex_t) < num_segments) {
+            return false;
+        }
+
+        index = (const TMColumnarIndex_t *) (map.data + index_offset);
+        for (uint32_t k = 0; k < num_segments; k++) {
+            if (index[k].offset > index_offset || index_offset - index[k].offset < segmentSize(index[k])) return false;
+        }
+
+        return true;
+    }
+
+    TMColumnarSegment segment(uint32_t k) const
+    {
+        TMColumnarSegment segment;
+        const uint8_t * base = map.data + index[k].offset;
+        uint32_t count = index[k].count;
+
+        segment.entry = &index[k];
+        segment.msg_ids = (const uint32_t *) base;
+        segment.gps_times = (const uint32_t *) (base + tmcAlign(4 * count));
+        segment.offsets = (const uint64_t *) (base + 2 * tmcAlign(4 * count));
+        segment.payload_ends = (const uint32_t *) (base + 2 * tmcAlign(4 * count) + 8 * count);
+        segment.payloads = base + 3 * tmcAlign(4 * count) + 8 * count;
+        return segment;
+    }
+
+    static uint64_t segmentSize(const TMColumnarIndex_t & entry)
+    {
+        return 3 * tmcAlign(4 * entry.count) + 8 * (uint64_t) entry.count + entry.payload_bytes;
+    }
+
+    const TMColumnarIndex_t * index = NULL;
+    uint32_t num_segments = 0;
+    uint64_t num_records = 0;
+
+private:
+    TMArchiveMap map;
+};
+
+#endif /* TM_COLUMNAR_H */
@@ -0,0 +1,224 @@
+/*
+ * tmlog_expand.cpp
+ * Created: October 2026
+ *
+ * Ground tool that expands deferred log TMs (see TMLog.h) into text, using
+ * the instrument's log message list. Build it against the same list header
+ * as the instrument software, naming the header and its list macro:
+ *
+ *     g++ -std=c++11 -I.. -DTMLOG_FORMATS='"LPCLog.h"' -DTMLOG_LIST=LPC_LOG_MESSAGES \
+ *         tmlog_expand.cpp ../TMEncode.cpp -o tmlog_expand
+ *
+ * Usage: tmlog_expand payload.bin [payload.bin ...]
+ *
+ * Each file is the binary section of one log TM. Each record is printed as
+ * its time in ms and the expanded message.
+ */
+
+#include "TMLogFormat.h"
+#include "TMEncode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifndef TMLOG_FORMATS
+#error "define TMLOG_FORMATS as the log message list header, e.g. -DTMLOG_FORMATS='\"LPCLog.h\"'"
+#endif
+
+#ifndef TMLOG_LIST
+#error "define TMLOG_LIST as the log message list macro, e.g. -DTMLOG_LIST=LPC_LOG_MESSAGES"
+#endif
+
+#include TMLOG_FORMATS
+
+static const char * formats[] = { TMLOG_LIST(TMLOG_FORMAT_ENTRY) };
+static const uint32_t num_formats = sizeof(formats) / sizeof(formats[0]);
+
+struct Payload {
+    const uint8_t * data;
+    uint32_t length;
+    uint32_t pos;
+};
+
+static bool readVarint(Payload * in, uint32_t * value)
+{
+    uint32_t remaining = in->length - in->pos;
+    uint8_t num_bytes = TMDecodeVarint(in->data + in->pos, remaining > 0xFFFF ? 0xFFFF : remaining, value);
+
+    in->pos += num_bytes;
+    return 0 != num_bytes;
+}
+
+static bool readFloat(Payload * in, float * value)
+{
+    uint32_t bits;
+
+    if (in->length - in->pos < 4) return false;
+
+    bits = ((uint32_t) in->data[in->pos] << 24) | ((uint32_t) in->data[in->pos + 1] << 16) |
+           ((uint32_t) in->data[in->pos + 2] << 8) | in->data[in->pos + 3];
+    memcpy(value, &bits, 4);
+    in->pos += 4;
+    return true;
+}
+
+// expand one record's format string, reading its arguments from the payload
+static bool expand(const char * format, Payload * in, std::string * out)
+{
+    char spec[32];
+    char text[256];
+    uint32_t value;
+    float fvalue;
+
+    for (const char * c = format; '\0' != *c; c++) {
+        if ('%' != *c) {
+            out->push_back(*c);
+            continue;
+        }
+
+        if ('%' == c[1]) {
+            out->push_back('%');
+            c++;
+            continue;
+        }
+
+        // copy the flags, width and precision, dropping any length modifier
+        size_t spec_len = 0;
+        spec[spec_len++] = '%';
+        c++;
+        while ('\0' != *c && strchr("-+ #0123456789.*", *c) && spec_len < sizeof(spec) - 4) {
+            spec[spec_len++] = *c++;
+        }
+        while ('\0' != *c && strchr("hlLqjzt", *c)) c++;
+        if ('\0' == *c) return false;
+
+        switch (*c) {
+        case 'd':
+        case 'i':
+            if (!readVarint(in, &value)) return false;
+            memcpy(spec + spec_len, "ld", 3);
+            snprintf(text, sizeof(text), spec, (long) TMUnZigZag(value));
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            if (!readVarint(in, &value)) return false;
+            spec[spec_len++] = 'l';
+            spec[spec_len++] = *c;
+            spec[spec_len] = '\0';
+            snprintf(text, sizeof(text), spec, (unsigned long) value);
+            break;
+        case 'c':
+            if (!readVarint(in, &value)) return false;
+            memcpy(spec + spec_len, "c", 2);
+            snprintf(text, sizeof(text), spec, (int) value);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+            if (!readFloat(in, &fvalue)) return false;
+            spec[spec_len++] = *c;
+            spec[spec_len] = '\0';
+            snprintf(text, sizeof(text), spec, (double) fvalue);
+            break;
+        case 's':
+            if (!readVarint(in, &value) || in->length - in->pos < value) return false;
+            out->append((const char *) in->data + in->pos, value);
+            in->pos += value;
+            text[0] = '\0';
+            break;
+        default:
+            return false;
+        }
+
+        out->append(text);
+    }
+
+    return true;
+}
+
+static bool expandPayload(const char * name, Payload * in)
+{
+    uint32_t count, base_time, time, id, delta;
+    std::string line;
+
+    if (in->length < 2 || TMLOG_MAGIC != in->data[0] || TMLOG_VERSION != in->data[1]) {
+        fprintf(stderr, "%s: not a version %d log TM\n", name, TMLOG_VERSION);
+        return false;
+    }
+    in->pos = 2;
+
+    if (!readVarint(in, &count) || in->length - in->pos < 4) {
+        fprintf(stderr, "%s: truncated header\n", name);
+        return false;
+    }
+    base_time = ((uint32_t) in->data[in->pos] << 24) | ((uint32_t) in->data[in->pos + 1] << 16) |
+                ((uint32_t) in->data[in->pos + 2] << 8) | in->data[in->pos + 3];
+    in->pos += 4;
+
+    time = base_time;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!readVarint(in, &id) || !readVarint(in, &delta)) {
+            fprintf(stderr, "%s: truncated at record %u\n", name, i);
+            return false;
+        }
+        time += delta;
+
+        if (id >= num_formats) {
+            fprintf(stderr, "%s: unknown message id %u at record %u\n", name, id, i);
+            return false;
+        }
+
+        line.clear();
+        if (!expand(formats[id], in, &line)) {
+            fprintf(stderr, "%s: bad arguments for message %u at record %u\n", name, id, i);
+            return false;
+        }
+
+        printf("%10u  %s\n", time, line.c_str());
+    }
+
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    int status = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s payload.bin [payload.bin ...]\n", argv[0]);
+        return 2;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        FILE * file = fopen(argv[i], "rb");
+        std::vector<uint8_t> data;
+        uint8_t chunk[4096];
+        size_t num_read;
+        Payload in;
+
+        if (NULL == file) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+
+        while (0 != (num_read = fread(chunk, 1, sizeof(chunk), file))) {
+            data.insert(data.end(), chunk, chunk + num_read);
+        }
+        fclose(file);
+
+        in.data = data.data();
+        in.length = data.size();
+        in.pos = 0;
+        if (!expandPayload(argv[i], &in)) status = 1;
+    }
+
+    return status;
+}